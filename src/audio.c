@@ -0,0 +1,291 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Software mixer. The device asks for audio through mix_audio(), which
+	starts the voices the game has asked for since the last call and adds
+	every playing voice into the buffer with saturation. The game thread
+	asks for sounds through a ring of commands with one writer and one
+	reader, so it never waits on the audio thread.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shipxb11.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static Sint16 scale_sample(Sint16 sample, Sint16 gain)
+{
+	Sint32 scaled = ((Sint32)sample * gain) >> 15;
+	return scaled > 32767 ? 32767 : scaled < -32768 ? -32768 : scaled;
+}
+
+static void mix_samples_scalar(Sint16 *out, const Sint16 *in, int i, int count, Sint16 left, Sint16 right)
+{
+	for (; i < count; i++) {
+		Sint32 mixed = out[i] + scale_sample(in[i], i & 1 ? right : left);
+		out[i] = mixed > 32767 ? 32767 : mixed < -32768 ? -32768 : mixed;
+	}
+}
+
+#ifdef __SSE2__
+// Same sums as the scalar loop, eight samples (four frames) at a time.
+static int mix_samples_sse2(Sint16 *out, const Sint16 *in, int count, Sint16 left, Sint16 right)
+{
+	__m128i gain = _mm_set_epi16(right, left, right, left, right, left, right, left);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i sample = _mm_loadu_si128((const __m128i *)&in[i]);
+		__m128i low = _mm_mullo_epi16(sample, gain);
+		__m128i high = _mm_mulhi_epi16(sample, gain);
+		__m128i first = _mm_srai_epi32(_mm_unpacklo_epi16(low, high), 15);
+		__m128i second = _mm_srai_epi32(_mm_unpackhi_epi16(low, high), 15);
+		__m128i scaled = _mm_packs_epi32(first, second);
+		__m128i mixed = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)&out[i]), scaled);
+		_mm_storeu_si128((__m128i *)&out[i], mixed);
+	}
+
+	return i;
+}
+#endif
+
+// Add count interleaved stereo samples of in, scaled by the left and right gains, to out.
+void mix_samples(Sint16 *out, const Sint16 *in, int count, Sint16 left, Sint16 right)
+{
+	int i = 0;
+
+#ifdef __SSE2__
+	i = mix_samples_sse2(out, in, count, left, right);
+#endif
+
+	mix_samples_scalar(out, in, i, count, left, right);
+}
+
+static void start_voice(Audio *audio, AudioCommand *command)
+{
+	AudioInfo *info = &audio->audio_info[command->sound];
+	Voice *voice = &audio->voice[0];
+
+	if (info->wave_buffer == NULL) {
+		return;
+	}
+
+	// Take a free voice, or cut off the one that has played longest.
+	for (int i = 0; i < MAX_VOICES; i++) {
+		if (audio->voice[i].sample == NULL) {
+			voice = &audio->voice[i];
+			break;
+		}
+
+		if (audio->voice[i].started < voice->started) {
+			voice = &audio->voice[i];
+		}
+	}
+
+	if (voice->sample != NULL) {
+		audio->stolen_voices++;
+	}
+
+	voice->sample = (const Sint16 *)info->wave_buffer;
+	voice->frames = info->wave_length / (2 * sizeof(Sint16));
+	voice->position = 0;
+	voice->started = audio->callbacks;
+	voice->gain[0] = command->gain[0];
+	voice->gain[1] = command->gain[1];
+}
+
+static void mix_audio(void *userdata, Uint8 *stream, int length)
+{
+	Audio *audio = userdata;
+	Sint16 *out = (Sint16 *)stream;
+	Uint32 frames = length / (2 * sizeof(Sint16));
+	Uint64 now = SDL_GetPerformanceCounter();
+	int head = SDL_AtomicGet(&audio->command_head);
+	int tail = SDL_AtomicGet(&audio->command_tail);
+
+	if (audio->callbacks > 0 && now - audio->last_callback > 2 * SDL_GetPerformanceFrequency() * audio->device_spec.samples / audio->device_spec.freq) {
+		audio->late_callbacks++;
+	}
+
+	audio->last_callback = now;
+	audio->callbacks++;
+
+	for (; head != tail; head++) {
+		start_voice(audio, &audio->command[head % AUDIO_COMMANDS]);
+	}
+
+	// Hand the slots back only once the commands have been read.
+	SDL_AtomicSet(&audio->command_head, head);
+	memset(stream, 0, length);
+
+	for (int i = 0; i < MAX_VOICES; i++) {
+		Voice *voice = &audio->voice[i];
+
+		if (voice->sample == NULL) {
+			continue;
+		}
+
+		Uint32 count = SDL_min(frames, voice->frames - voice->position);
+		mix_samples(out, voice->sample + 2 * voice->position, 2 * count, voice->gain[0], voice->gain[1]);
+		voice->position += count;
+
+		if (voice->position == voice->frames) {
+			voice->sample = NULL;
+		}
+	}
+
+	mix_music(&audio->music, out, 2 * frames);
+}
+
+void init_audio(Game *game)
+{
+	Audio *audio = &game->audio;
+	SDL_AudioSpec wanted;
+	SDL_AudioSpec obtained;
+	int status = 1;
+	audio->dropped_sounds = 0;
+	audio->callbacks = 0;
+	audio->last_callback = 0;
+	audio->late_callbacks = 0;
+	audio->stolen_voices = 0;
+	audio->is_muted = SDL_FALSE;
+	SDL_AtomicSet(&audio->command_head, 0);
+	SDL_AtomicSet(&audio->command_tail, 0);
+
+	for (unsigned int i = 0; i < SOUNDS; i++) {
+		audio->audio_info[i].wave_buffer = NULL;
+		audio->audio_info[i].wave_length = 0;
+		audio->audio_info[i].converted = SDL_FALSE;
+	}
+
+	for (int i = 0; i < MAX_VOICES; i++) {
+		audio->voice[i].sample = NULL;
+	}
+
+	audio->music.ring = NULL;
+
+	SDL_zero(wanted);
+#if SDL_PATCHLEVEL > 15
+	status = SDL_GetAudioDeviceSpec(0, 0, &wanted);
+#endif
+
+	if (status != 0) {
+		wanted.freq = 48000;
+	}
+
+	// The mixer works in stereo 16 bit samples, SDL converts if the device wants something else.
+	wanted.format = AUDIO_S16SYS;
+	wanted.channels = 2;
+	wanted.samples = AUDIO_SAMPLES;
+	wanted.callback = mix_audio;
+	wanted.userdata = audio;
+	audio->id = SDL_OpenAudioDevice(NULL, 0, &wanted, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+
+	if (audio->id == 0) {
+		return;
+	}
+
+	audio->device_spec = obtained;
+}
+
+void close_audio(Game *game)
+{
+	Audio *audio = &game->audio;
+	SDL_CloseAudioDevice(audio->id);
+	stop_music(game);
+
+	// SDL does not count underruns, so a callback that came late is the nearest sign of one.
+	if (audio->late_callbacks > 0 || audio->dropped_sounds > 0 || audio->stolen_voices > 0) {
+		fprintf(stderr, "%s: Audio was late %d times in %llu buffers, dropped %d sounds and cut off %d.\n", game->title, audio->late_callbacks, (unsigned long long)audio->callbacks, audio->dropped_sounds, audio->stolen_voices);
+	}
+
+	for (unsigned int i = 0; i < SOUNDS; i++) {
+		if (audio->audio_info[i].wave_buffer == NULL) {
+			continue;
+		}
+
+		if (audio->audio_info[i].converted) {
+			SDL_free(audio->audio_info[i].wave_buffer);
+		} else {
+			SDL_FreeWAV(audio->audio_info[i].wave_buffer);
+		}
+	}
+}
+
+// Convert the sound to the device's format.
+int load_audio(Game *game, int sound)
+{
+	SDL_AudioCVT cvt;
+	AudioInfo *info = &game->audio.audio_info[sound];
+	LoadJob *job = wait_for_job(game, IMAGES + sound);
+
+	if (job->wave_buffer == NULL) {
+		return 1;
+	}
+
+	info->audio_spec = job->audio_spec;
+	info->wave_buffer = job->wave_buffer;
+	info->wave_length = job->wave_length;
+	job->wave_buffer = NULL;
+	SDL_AudioSpec *audio_spec = &info->audio_spec;
+	SDL_BuildAudioCVT(&cvt, audio_spec->format, audio_spec->channels, audio_spec->freq, game->audio.device_spec.format, game->audio.device_spec.channels, game->audio.device_spec.freq);
+
+	if (cvt.needed) {
+		cvt.len = info->wave_length;
+		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
+		memcpy(cvt.buf, info->wave_buffer, info->wave_length);
+		SDL_ConvertAudio(&cvt);
+		SDL_FreeWAV(info->wave_buffer);
+		info->converted = SDL_TRUE;
+		info->wave_buffer = cvt.buf;
+		info->wave_length = cvt.len_cvt;
+	}
+
+	return 0;
+}
+
+// Gain is from 0 to 1, pan from -1 (left) to 1 (right). Never blocks; the sound is dropped if the ring is full.
+void play_sound(Game *game, int sound, double gain, double pan)
+{
+	Audio *audio = &game->audio;
+
+	// The headless simulator runs without an audio device.
+	if (audio->id == 0 || audio->is_muted) {
+		return;
+	}
+
+	int tail = SDL_AtomicGet(&audio->command_tail);
+
+	if (tail - SDL_AtomicGet(&audio->command_head) == AUDIO_COMMANDS) {
+		audio->dropped_sounds++;
+		return;
+	}
+
+	pan = SDL_max(-1.0, SDL_min(1.0, pan));
+	AudioCommand *command = &audio->command[tail % AUDIO_COMMANDS];
+	command->sound = sound;
+	command->gain[0] = 32767 * gain * SDL_min(1.0, 1.0 - pan);
+	command->gain[1] = 32767 * gain * SDL_min(1.0, 1.0 + pan);
+	// Publish the command only once it is written.
+	SDL_AtomicSet(&audio->command_tail, tail + 1);
+}
@@ -0,0 +1,272 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Tests one box against the boxes in an EntityStore. collide_boxes()
+	checks every box, with vector loops that use the same double precision
+	sums and negated comparisons as the scalar test, so they give exactly
+	the same answers, including at the edges where boxes only touch.
+	query_grid() checks only the boxes sharing a grid cell with the box,
+	for populations too large to scan.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shipxb11.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+static SDL_bool box_hit(EntityStore *store, int k, double x, double y, double right, double bottom)
+{
+	return !(x > (store->x[k] + store->width[k]) || right < store->x[k] || y > (store->y[k] + store->height[k]) || bottom < store->y[k]);
+}
+
+static void collide_boxes_scalar(EntityStore *store, int k, double x, double y, double right, double bottom, Uint64 *mask)
+{
+	for (; k < store->count; k++) {
+		if (box_hit(store, k, x, y, right, bottom)) {
+			mask[k >> 6] |= (Uint64)1 << (k & 63);
+		}
+	}
+}
+
+#ifdef __SSE2__
+static int collide_boxes_sse2(EntityStore *store, int k, double x, double y, double right, double bottom, Uint64 *mask)
+{
+	__m128d bx = _mm_set1_pd(x);
+	__m128d by = _mm_set1_pd(y);
+	__m128d br = _mm_set1_pd(right);
+	__m128d bb = _mm_set1_pd(bottom);
+
+	for (; k + 2 <= store->count; k += 2) {
+		__m128d ex = _mm_loadu_pd(&store->x[k]);
+		__m128d ey = _mm_loadu_pd(&store->y[k]);
+		__m128d ew = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&store->width[k]));
+		__m128d eh = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)&store->height[k]));
+		__m128d hit = _mm_cmpngt_pd(bx, _mm_add_pd(ex, ew));
+		hit = _mm_and_pd(hit, _mm_cmpnlt_pd(br, ex));
+		hit = _mm_and_pd(hit, _mm_cmpngt_pd(by, _mm_add_pd(ey, eh)));
+		hit = _mm_and_pd(hit, _mm_cmpnlt_pd(bb, ey));
+		// k is even, so both bits land in the same word.
+		mask[k >> 6] |= (Uint64)_mm_movemask_pd(hit) << (k & 63);
+	}
+
+	return k;
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static int collide_boxes_avx2(EntityStore *store, int k, double x, double y, double right, double bottom, Uint64 *mask)
+{
+	__m256d bx = _mm256_set1_pd(x);
+	__m256d by = _mm256_set1_pd(y);
+	__m256d br = _mm256_set1_pd(right);
+	__m256d bb = _mm256_set1_pd(bottom);
+
+	for (; k + 4 <= store->count; k += 4) {
+		__m256d ex = _mm256_loadu_pd(&store->x[k]);
+		__m256d ey = _mm256_loadu_pd(&store->y[k]);
+		__m256d ew = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&store->width[k]));
+		__m256d eh = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&store->height[k]));
+		__m256d hit = _mm256_cmp_pd(bx, _mm256_add_pd(ex, ew), _CMP_NGT_UQ);
+		hit = _mm256_and_pd(hit, _mm256_cmp_pd(br, ex, _CMP_NLT_UQ));
+		hit = _mm256_and_pd(hit, _mm256_cmp_pd(by, _mm256_add_pd(ey, eh), _CMP_NGT_UQ));
+		hit = _mm256_and_pd(hit, _mm256_cmp_pd(bb, ey, _CMP_NLT_UQ));
+		// k is a multiple of 4, so all four bits land in the same word.
+		mask[k >> 6] |= (Uint64)_mm256_movemask_pd(hit) << (k & 63);
+	}
+
+	return k;
+}
+#endif
+
+// Set bit k of mask, which needs (store->count + 63) / 64 words, when entity k overlaps the box.
+void collide_boxes(EntityStore *store, double x, double y, int width, int height, Uint64 *mask)
+{
+	double right = x + width;
+	double bottom = y + height;
+	int k = 0;
+
+	memset(mask, 0, sizeof(Uint64) * ((store->count + 63) / 64));
+
+#ifdef HAVE_AVX2_KERNEL
+	if (SDL_HasAVX2()) {
+		k = collide_boxes_avx2(store, k, x, y, right, bottom, mask);
+	}
+#endif
+
+#ifdef __SSE2__
+	k = collide_boxes_sse2(store, k, x, y, right, bottom, mask);
+#endif
+
+	collide_boxes_scalar(store, k, x, y, right, bottom, mask);
+}
+
+void init_grid(Game *game, SpatialGrid *grid, int capacity)
+{
+	grid->columns = (game->width + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE;
+	grid->rows = (game->height + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE;
+	grid->is_built = SDL_FALSE;
+	grid->cell_start = (int *)malloc(sizeof(int) * (grid->columns * grid->rows + 1));
+	grid->cell = (int *)malloc(sizeof(int) * capacity);
+	grid->item = (int *)malloc(sizeof(int) * capacity);
+	grid->chunk_start = (int *)malloc(sizeof(int) * grid->columns * grid->rows * MAX_TASK_CHUNKS);
+
+	if (grid->cell_start == NULL || grid->cell == NULL || grid->item == NULL || grid->chunk_start == NULL) {
+		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+}
+
+void free_grid(SpatialGrid *grid)
+{
+	free(grid->cell_start);
+	free(grid->cell);
+	free(grid->item);
+	free(grid->chunk_start);
+}
+
+// Anything off the playfield goes in the nearest edge cell, which keeps the order of positions.
+static int grid_cell(double position, int cells)
+{
+	if (!(position > 0)) {
+		return 0;
+	}
+
+	int cell = position / GRID_CELL_SIZE;
+	return cell < cells ? cell : cells - 1;
+}
+
+typedef struct {
+	SpatialGrid *grid;
+	EntityStore *store;
+} GridBuild;
+
+// Find the cell of each entity in the chunk, and count them per cell in the chunk's row of chunk_start.
+static void count_grid_cells(Game *game, void *data, int chunk, int start, int end, int worker)
+{
+	SpatialGrid *grid = ((GridBuild *)data)->grid;
+	EntityStore *store = ((GridBuild *)data)->store;
+	int *count = &grid->chunk_start[chunk * grid->columns * grid->rows];
+	int max_width = 0, max_height = 0;
+
+	memset(count, 0, sizeof(int) * grid->columns * grid->rows);
+
+	for (int k = start; k < end; k++) {
+		if (!(store->flags[k] & ENTITY_VISIBLE)) {
+			grid->cell[k] = -1;
+			continue;
+		}
+
+		grid->cell[k] = grid_cell(store->y[k], grid->rows) * grid->columns + grid_cell(store->x[k], grid->columns);
+		count[grid->cell[k]]++;
+		max_width = SDL_max(max_width, store->width[k]);
+		max_height = SDL_max(max_height, store->height[k]);
+	}
+
+	grid->chunk_max_width[chunk] = max_width;
+	grid->chunk_max_height[chunk] = max_height;
+}
+
+static void fill_grid_cells(Game *game, void *data, int chunk, int start, int end, int worker)
+{
+	SpatialGrid *grid = ((GridBuild *)data)->grid;
+	int *next = &grid->chunk_start[chunk * grid->columns * grid->rows];
+
+	for (int k = start; k < end; k++) {
+		if (grid->cell[k] >= 0) {
+			grid->item[next[grid->cell[k]]++] = k;
+		}
+	}
+}
+
+/*
+	Each visible entity goes in the one cell holding its top left corner,
+	so a rebuild is two passes and a counting sort. Queries make up for
+	that by reaching back by the size of the largest entity.
+
+	Both passes run in chunks on the workers. Each chunk counts its own
+	cells, and fills the part of each cell that follows the chunks before
+	it, so the items of a cell stay in store order however it is split.
+*/
+void build_grid(Game *game, SpatialGrid *grid, EntityStore *store)
+{
+	GridBuild build = { grid, store };
+	int cells = grid->columns * grid->rows;
+	int chunks = task_chunks(game, store->count);
+	int start = 0;
+
+	parallel_for(game, store->count, count_grid_cells, &build);
+	grid->max_width = grid->max_height = 0;
+
+	for (int c = 0; c < cells; c++) {
+		grid->cell_start[c] = start;
+
+		for (int chunk = 0; chunk < chunks; chunk++) {
+			int count = grid->chunk_start[chunk * cells + c];
+			grid->chunk_start[chunk * cells + c] = start;
+			start += count;
+		}
+	}
+
+	grid->cell_start[cells] = start;
+
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		grid->max_width = SDL_max(grid->max_width, grid->chunk_max_width[chunk]);
+		grid->max_height = SDL_max(grid->max_height, grid->chunk_max_height[chunk]);
+	}
+
+	parallel_for(game, store->count, fill_grid_cells, &build);
+	grid->is_built = SDL_TRUE;
+}
+
+// Like collide_boxes(), for a grid built from the store this tick. Only visible entities are found.
+void query_grid(SpatialGrid *grid, EntityStore *store, double x, double y, int width, int height, Uint64 *mask)
+{
+	double right = x + width;
+	double bottom = y + height;
+	int first_column = grid_cell(x - grid->max_width, grid->columns);
+	int last_column = grid_cell(right, grid->columns);
+	int first_row = grid_cell(y - grid->max_height, grid->rows);
+	int last_row = grid_cell(bottom, grid->rows);
+
+	memset(mask, 0, sizeof(Uint64) * ((store->count + 63) / 64));
+
+	for (int row = first_row; row <= last_row; row++) {
+		int first = grid->cell_start[row * grid->columns + first_column];
+		int last = grid->cell_start[row * grid->columns + last_column + 1];
+
+		// The cells of a row are next to each other in item.
+		for (int i = first; i < last; i++) {
+			int k = grid->item[i];
+
+			if (box_hit(store, k, x, y, right, bottom)) {
+				mask[k >> 6] |= (Uint64)1 << (k & 63);
+			}
+		}
+	}
+}
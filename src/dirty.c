@@ -0,0 +1,170 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	With -u the software renderer draws straight into the window's surface,
+	which keeps its pixels from one frame to the next, so only what has
+	changed needs drawing again. Those are the tiles under each sprite and
+	HUD quad, where it is now and where it was last frame, joined into as
+	few rectangles as a row by row pass finds. Each rectangle is redrawn
+	with the renderer clipped to it, and only the rectangles are updated on
+	the window. The background is held still, as a scrolling one would
+	change every pixel. When most tiles change, the whole window is drawn
+	as normal.
+*/
+
+#include <stdlib.h>
+#include "shipxb11.h"
+
+// Call in place of SDL_CreateRenderer(). Returns NULL, with SDL's error set, on failure.
+SDL_Renderer *create_dirty_renderer(Game *game)
+{
+	DirtyRects *dirty = &game->dirty;
+	SDL_Surface *surface = SDL_GetWindowSurface(game->window);
+
+	if (surface == NULL) {
+		return NULL;
+	}
+
+	dirty->is_full = SDL_TRUE;
+	dirty->columns = (game->width + DIRTY_TILE - 1) / DIRTY_TILE;
+	dirty->rows = (game->height + DIRTY_TILE - 1) / DIRTY_TILE;
+	dirty->current = 0;
+	dirty->count = 0;
+
+	for (int i = 0; i < 2; i++) {
+		dirty->drawn[i] = allocate(game, dirty->columns * dirty->rows, __func__);
+	}
+
+	dirty->rect = allocate(game, sizeof(SDL_Rect) * dirty->columns * dirty->rows, __func__);
+	return SDL_CreateSoftwareRenderer(surface);
+}
+
+static void mark_tiles(DirtyRects *dirty, Uint8 *drawn, const SDL_Rect *rect, int width, int height)
+{
+	int left = SDL_max(rect->x, 0);
+	int top = SDL_max(rect->y, 0);
+	int right = SDL_min(rect->x + rect->w, width);
+	int bottom = SDL_min(rect->y + rect->h, height);
+
+	if (left >= right || top >= bottom) {
+		return;
+	}
+
+	for (int row = top / DIRTY_TILE; row <= (bottom - 1) / DIRTY_TILE; row++) {
+		for (int column = left / DIRTY_TILE; column <= (right - 1) / DIRTY_TILE; column++) {
+			drawn[row * dirty->columns + column] = 1;
+		}
+	}
+}
+
+// Lengthen a rectangle from the row above with the same span, or start a new one.
+static void add_span(Game *game, int column, int end, int row)
+{
+	DirtyRects *dirty = &game->dirty;
+	SDL_Rect span = { column * DIRTY_TILE, row * DIRTY_TILE, (end - column) * DIRTY_TILE, DIRTY_TILE };
+
+	for (int i = 0; i < dirty->count; i++) {
+		if (dirty->rect[i].x == span.x && dirty->rect[i].w == span.w && dirty->rect[i].y + dirty->rect[i].h == span.y) {
+			dirty->rect[i].h += DIRTY_TILE;
+			return;
+		}
+	}
+
+	dirty->rect[dirty->count++] = span;
+}
+
+/*
+	Called with the frame's queued commands, sorted, before any are drawn.
+	Sets the rectangles to redraw, which are the whole window if that has
+	been asked for or if most of it has changed anyway.
+*/
+void find_dirty_rects(Game *game, const DrawCommand *command, int count)
+{
+	DirtyRects *dirty = &game->dirty;
+	SDL_Rect window = { 0, 0, game->width, game->height };
+	Uint8 *drawn = dirty->drawn[dirty->current];
+	Uint8 *last = dirty->drawn[dirty->current ^ 1];
+	int tiles = dirty->columns * dirty->rows;
+	int changed = 0;
+
+	SDL_memset(drawn, 0, tiles);
+
+	for (int i = 0; i < count; i++) {
+		if (command[i].layer != LAYER_BACKGROUND) {
+			mark_tiles(dirty, drawn, &command[i].drect, game->width, game->height);
+		}
+	}
+
+	for (int i = 0; i < tiles; i++) {
+		changed += drawn[i] | last[i];
+	}
+
+	dirty->current ^= 1;
+	dirty->count = 0;
+
+#ifdef SHIPXB11_PROFILE
+	// The frame graph is drawn over the top, outside the tiles.
+	dirty->is_full |= game->profiler.show_graph;
+#endif
+
+	if (dirty->is_full || changed > tiles * 3 / 4) {
+		dirty->rect[dirty->count++] = window;
+		dirty->is_full = SDL_FALSE;
+		return;
+	}
+
+	for (int row = 0; row < dirty->rows; row++) {
+		int column = 0;
+
+		while (column < dirty->columns) {
+			int start;
+
+			if (!(drawn[row * dirty->columns + column] | last[row * dirty->columns + column])) {
+				column++;
+				continue;
+			}
+
+			for (start = column; column < dirty->columns && (drawn[row * dirty->columns + column] | last[row * dirty->columns + column]); column++);
+			add_span(game, start, column, row);
+		}
+	}
+
+	// Tiles along the right and bottom edges may reach past the window.
+	for (int i = 0; i < dirty->count; i++) {
+		SDL_IntersectRect(&dirty->rect[i], &window, &dirty->rect[i]);
+	}
+}
+
+// In place of SDL_RenderPresent(). Draws what is queued in the renderer, and shows only the changed rectangles.
+void present_dirty_rects(Game *game)
+{
+	SDL_RenderFlush(game->renderer);
+	SDL_UpdateWindowSurfaceRects(game->window, game->dirty.rect, game->dirty.count);
+}
+
+void free_dirty_rects(Game *game)
+{
+	if (!game->dirty.is_enabled) {
+		return;
+	}
+
+	free(game->dirty.drawn[0]);
+	free(game->dirty.drawn[1]);
+	free(game->dirty.rect);
+}
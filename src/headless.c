@@ -0,0 +1,413 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	shipxb11-sim runs the game simulation with no window, renderer or audio,
+	as fast as the CPU allows, and reports throughput and the final state.
+	It can record its input, or play back a session recorded by the game,
+	check that rolling back and simulating again gives the same game, or play
+	one side of a network game against another shipxb11-sim or the game.
+*/
+
+#include <SDL2/SDL.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shipxb11.h"
+
+#define DEFAULT_TICKS 100000
+
+typedef struct {
+	FILE *script; // NULL for random input.
+	SDL_bool fire;
+	Uint32 random_state;
+	long next_tick; // Tick of the next script line, or -1 at the end of the script.
+	unsigned int key;
+	unsigned int next_key;
+	SDL_bool next_fire;
+} Input;
+
+// Script lines are "<tick> <keys>", where keys is any of L, R and F, or - for none.
+static void read_script_line(Input *input)
+{
+	char keys[16];
+
+	if (fscanf(input->script, "%ld %15s", &input->next_tick, keys) != 2) {
+		input->next_tick = -1;
+		return;
+	}
+
+	input->next_key = NO_KEY;
+	input->next_fire = SDL_FALSE;
+
+	for (char *c = keys; *c != '\0'; c++) {
+		if (*c == 'L') {
+			input->next_key = LEFT_KEY;
+		} else if (*c == 'R') {
+			input->next_key = RIGHT_KEY;
+		} else if (*c == 'F') {
+			input->next_fire = SDL_TRUE;
+		}
+	}
+}
+
+static void next_input(Input *input, long tick)
+{
+	if (input->script != NULL) {
+		while (input->next_tick >= 0 && input->next_tick <= tick) {
+			input->key = input->next_key;
+			input->fire = input->next_fire;
+			read_script_line(input);
+		}
+
+		return;
+	}
+
+	// Hold a direction for a while, as a player would, and fire often.
+	if ((xorshift32(&input->random_state) & 31) == 0) {
+		unsigned int keys[3] = { NO_KEY, LEFT_KEY, RIGHT_KEY };
+		input->key = keys[xorshift32(&input->random_state) % 3];
+	}
+
+	input->fire = (xorshift32(&input->random_state) & 7) == 0;
+}
+
+static int parse_number(const char *option, const char *value, long *number)
+{
+	char *end;
+
+	if (value != NULL) {
+		*number = strtol(value, &end, 10);
+
+		if (*end == '\0' && *number >= 0) {
+			return 0;
+		}
+	}
+
+	fprintf(stderr, "%s: Option %s needs a number.\n", GAME_TITLE, option);
+	return 1;
+}
+
+static int parse_options(int argc, char *argv[], long *seed, long *ticks, long *aliens, long *rollback, long *workers, Input *input, Replay *replay, NetSession *net)
+{
+	for (int i = 1; i < argc; i++) {
+		int status = 0;
+
+		if (strcmp(argv[i], "-s") == 0) {
+			status = parse_number(argv[i], argv[i + 1], seed);
+		} else if (strcmp(argv[i], "-n") == 0) {
+			status = parse_number(argv[i], argv[i + 1], ticks);
+		} else if (strcmp(argv[i], "-a") == 0) {
+			status = parse_number(argv[i], argv[i + 1], aliens);
+
+			if (status == 0 && (*aliens < 1 || *aliens > MAX_ALIEN_POPULATION)) {
+				fprintf(stderr, "%s: Option %s needs a number from 1 to %d.\n", GAME_TITLE, argv[i], MAX_ALIEN_POPULATION);
+				status = 1;
+			}
+		} else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+			if (strcmp(argv[i + 1], "random") != 0) {
+				input->script = fopen(argv[i + 1], "r");
+
+				if (input->script == NULL) {
+					fprintf(stderr, "%s: Failed to open %s.\n", GAME_TITLE, argv[i + 1]);
+					return 1;
+				}
+			}
+		} else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "-p") == 0) && i + 1 < argc) {
+			replay->path = argv[i + 1];
+			replay->is_playing = argv[i][1] == 'p';
+		} else if (strcmp(argv[i], "-b") == 0) {
+			status = parse_number(argv[i], argv[i + 1], rollback);
+		} else if (strcmp(argv[i], "-j") == 0) {
+			status = parse_number(argv[i], argv[i + 1], workers);
+
+			if (status == 0 && (*workers < 0 || *workers > MAX_WORKERS)) {
+				fprintf(stderr, "%s: Option %s needs a number from 0 to %d.\n", GAME_TITLE, argv[i], MAX_WORKERS);
+				status = 1;
+			}
+		} else if (strcmp(argv[i], "-H") == 0) {
+			long port;
+			status = parse_number(argv[i], argv[i + 1], &port);
+
+			if (status == 0 && (port < 1 || port > 65535)) {
+				fprintf(stderr, "%s: Option %s needs a number from 1 to 65535.\n", GAME_TITLE, argv[i]);
+				status = 1;
+			}
+
+			if (status == 0) {
+				net->port = port;
+				net->is_active = net->is_host = SDL_TRUE;
+			}
+		} else if (strcmp(argv[i], "-J") == 0 && i + 1 < argc) {
+			net->address = argv[i + 1];
+			net->is_active = SDL_TRUE;
+		} else if (strcmp(argv[i], "-L") == 0 || strcmp(argv[i], "-D") == 0) {
+			long value;
+			long most = argv[i][1] == 'L' ? 1000 : 100;
+			status = parse_number(argv[i], argv[i + 1], &value);
+
+			if (status == 0 && value > most) {
+				fprintf(stderr, "%s: Option %s needs a number from 0 to %ld.\n", GAME_TITLE, argv[i], most);
+				status = 1;
+			}
+
+			if (status == 0) {
+				*(argv[i][1] == 'L' ? &net->latency : &net->loss) = value;
+			}
+		} else {
+			fprintf(stderr, "Usage: %s [-s seed] [-n ticks] [-a aliens of each type] [-i random | script] [-r record to file | -p play back file] [-b roll back ticks] [-j threads, 0 for one per CPU] [-H host on port | -J join host:port] [-L added latency ms] [-D percent of packets dropped]\n", argv[0]);
+			return 1;
+		}
+
+		if (status != 0) {
+			return status;
+		}
+
+		i++;
+	}
+
+	if (net->is_active && (replay->path != NULL || *rollback > 0 || (net->is_host && net->address != NULL))) {
+		fprintf(stderr, "%s: Host or join a game, not both, and without -r, -p or -b.\n", GAME_TITLE);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	After every tick, go back rollback ticks and simulate them again from the
+	snapshots and inputs kept for them, as a network game would after a wrong
+	guess, and check the game comes out the same. Returns 1 if it does not,
+	which means some state is missing from the snapshot or not reset.
+*/
+static int check_rollback(Game *game, Uint8 *state, unsigned int *history, long rollback, long tick)
+{
+	Uint64 hash = hash_game_state(game);
+
+	if (tick + 1 < rollback) {
+		return 0;
+	}
+
+	load_snapshot(game, state + (tick + 1) % rollback * game->snapshot.size);
+
+	for (long t = tick + 1 - rollback; t <= tick; t++) {
+		if (history[t % rollback] & REPLAY_RESTART) {
+			reset_game(game);
+		}
+
+		game->player[0].key = history[t % rollback] & REPLAY_KEYS;
+		update_game(game);
+	}
+
+	if (hash_game_state(game) != hash) {
+		fprintf(stderr, "%s: Rolling back %ld ticks at tick %ld gave %016llx, not %016llx.\n", GAME_TITLE, rollback, tick, (unsigned long long)hash_game_state(game), (unsigned long long)hash);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Play one side of a network game for ticks ticks, the host restarting it
+	whenever it is over, then wait for the other side to agree on every
+	tick. Both sides should print the same hash. Returns 1 if the other side
+	went away.
+*/
+static int play_net_game(Game *game, Input *input, long ticks, int *games)
+{
+	NetSession *net = &game->net;
+	Player *player = &game->player[net->local];
+	long input_tick = -1;
+	SDL_bool restarted = SDL_FALSE;
+
+	while (net->tick < ticks) {
+		if (input_tick != net->tick) {
+			next_input(input, net->tick);
+			player->key = input->key | (input->fire ? FIRE_KEY : NO_KEY);
+			input_tick = net->tick;
+		}
+
+		// Lives may go back up in a rollback, so only ask once per game over.
+		if (game->lives == 0 && net->is_host && !restarted) {
+			net->restart = SDL_TRUE;
+			restarted = SDL_TRUE;
+			(*games)++;
+		} else if (game->lives != 0) {
+			restarted = SDL_FALSE;
+		}
+
+		int status = net_tick(game);
+
+		if (status < 0) {
+			return 1;
+		} else if (status == 0) {
+			SDL_Delay(1);
+		}
+	}
+
+	return settle_net(game);
+}
+
+int main(int argc, char *argv[])
+{
+	static Game game;
+	Input input = { NULL, SDL_FALSE, 0, 0, NO_KEY, NO_KEY, SDL_FALSE };
+	Replay replay;
+	static NetSession net;
+	long seed = 1;
+	long ticks = DEFAULT_TICKS;
+	long aliens = ALIEN_POPULATION;
+	long rollback = 0;
+	long workers = 0;
+	int games = 1, best_level = 1;
+	Uint8 *state = NULL;
+	unsigned int *history = NULL;
+	SDL_zero(replay);
+
+	if (parse_options(argc, argv, &seed, &ticks, &aliens, &rollback, &workers, &input, &replay, &net) != 0) {
+		return 1;
+	}
+
+	game.renderer = NULL;
+	game.audio.id = 0;
+	game.width = WIDTH;
+	game.height = HEIGHT;
+	init_game(&game);
+	game.alien_count = aliens;
+	game.replay.path = replay.path;
+	game.replay.is_playing = replay.is_playing;
+	game.net.is_active = net.is_active;
+	game.net.is_host = net.is_host;
+	game.net.address = net.address;
+	game.net.port = net.port;
+	game.net.latency = net.latency;
+	game.net.loss = net.loss;
+
+	// A playback or a joined game brings its own seed and aliens, and a playback runs to the end of the recording.
+	if (start_replay(&game, seed) != 0 || connect_net(&game, seed) != 0) {
+		return 1;
+	}
+
+	if (game.replay.is_playing) {
+		ticks = LONG_MAX;
+	}
+
+	start_loading(&game, SDL_FALSE);
+	int status = init_sprites(&game);
+	finish_loading(&game);
+	start_workers(&game, workers);
+
+	if (status != 0 || start_net_game(&game) != 0) {
+		return 1;
+	}
+
+	if (rollback > 0) {
+		init_snapshot(&game);
+		state = malloc(rollback * game.snapshot.size);
+		history = malloc(rollback * sizeof(unsigned int));
+
+		if (state == NULL || history == NULL) {
+			fprintf(stderr, "%s: malloc returned NULL in function %s\n", GAME_TITLE, __func__);
+			exit(1);
+		}
+	}
+
+	// Each side of a network game plays differently.
+	input.random_state = (Uint32)(seed + game.net.local) * 2654435761u + 1;
+
+	if (input.script != NULL) {
+		read_script_line(&input);
+	}
+
+	Uint64 start_time = SDL_GetPerformanceCounter();
+
+	long tick;
+
+	for (tick = 0; tick < ticks && !game.net.is_active; tick++) {
+		SDL_bool restart = SDL_FALSE;
+
+		if (rollback > 0) {
+			save_snapshot(&game, state + tick % rollback * game.snapshot.size);
+		}
+
+		// The game would wait for a key here, so start the next one straight away.
+		if (game.lives == 0 && !game.replay.is_playing) {
+			reset_game(&game);
+			game.replay.restart = SDL_TRUE;
+			restart = SDL_TRUE;
+		}
+
+		next_input(&input, tick);
+		game.player[0].key = input.key | (input.fire ? FIRE_KEY : NO_KEY);
+
+		if (replay_input(&game) != 0) {
+			break;
+		}
+
+		if (game.replay.is_playing && (game.replay.input & REPLAY_RESTART)) {
+			restart = SDL_TRUE;
+		}
+
+		games += restart;
+		unsigned int key = game.player[0].key;
+		update_game(&game);
+
+		if (game.level > best_level) {
+			best_level = game.level;
+		}
+
+		if (rollback > 0) {
+			history[tick % rollback] = key | (restart ? REPLAY_RESTART : 0);
+
+			if (check_rollback(&game, state, history, rollback, tick) != 0) {
+				status = 1;
+				break;
+			}
+		}
+	}
+
+	if (game.net.is_active) {
+		status = play_net_game(&game, &input, ticks, &games);
+		tick = game.net.tick;
+		best_level = game.level;
+	}
+
+	ticks = tick;
+
+	double seconds = (double)(SDL_GetPerformanceCounter() - start_time) / SDL_GetPerformanceFrequency();
+	printf("ticks: %ld\n", ticks);
+	printf("seconds: %.3f\n", seconds);
+	printf("ticks/sec: %.0f\n", seconds > 0 ? ticks / seconds : 0.0);
+	printf("games: %d\n", games);
+	printf("level: %d (best %d)\n", game.level, best_level);
+	printf("score: %d (high %d)\n", game.score.score, game.score.high);
+	printf("hash: %016llx\n", (unsigned long long)hash_game_state(&game));
+	status |= finish_replay(&game);
+	close_net(&game);
+	free(state);
+	free(history);
+
+	if (input.script != NULL) {
+		fclose(input.script);
+	}
+
+	stop_workers(&game);
+	free_sprites(&game);
+	return status;
+}
@@ -0,0 +1,262 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Decodes the images and sounds on a pool of threads, at start up while
+	the main thread gets on with opening the window and the audio device,
+	and later to bring back images whose textures were evicted. The main
+	thread takes each result with wait_for_job() as it needs it, decoding
+	the job itself if no thread has started it yet, so loading still works
+	with no threads at all.
+*/
+
+#include <SDL2/SDL_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+static const char *image_path[IMAGES] = {
+	DATADIR"/bigblue.png",
+	DATADIR"/player.png",
+	DATADIR"/purple.png",
+	DATADIR"/green.png",
+	DATADIR"/yellow.png",
+	DATADIR"/cyan.png",
+	DATADIR"/background.jpg",
+	DATADIR"/explosion.png",
+	DATADIR"/missile.png",
+	DATADIR"/playmis.png",
+	DATADIR"/line.png",
+	DATADIR"/asteroid.png",
+	DATADIR"/ul.png",
+	DATADIR"/ur.png",
+	DATADIR"/ll.png",
+	DATADIR"/lr.png"
+};
+
+static const char *sound_path[SOUNDS] = {
+	DATADIR"/explode.wav"
+};
+
+static SDL_Surface *load_image_with_index(Game *game, const char *path, unsigned int indx)
+{
+	SDL_Surface *surface = NULL;
+	char *ext = strrchr(path, '.');
+	char filename[FILENAME_MAX];
+
+	snprintf(filename, sizeof(filename), "%.*s%02d%s", (int)(ext - path), path, indx, ext);
+	surface = IMG_Load(filename);
+
+	if (surface == NULL && indx == 0) {
+		fprintf(stderr, "%s: In function %s\n", game->title, __func__);
+		fprintf(stderr, "%s: Failed to load %s.\n", game->title, filename);
+	}
+
+	return surface;
+}
+
+static void load_frames(Game *game, LoadJob *job)
+{
+	SDL_Surface *surface;
+
+	while ((surface = load_image_with_index(game, job->path, job->frame_count)) != NULL) {
+		job->frame = realloc(job->frame, sizeof(SDL_Surface *) * (job->frame_count + 1));
+
+		if (job->frame == NULL) {
+			fprintf(stderr, "%s: realloc returned NULL in function %s\n", game->title, __func__);
+			exit(1);
+		}
+
+		job->frame[job->frame_count++] = surface;
+	}
+}
+
+// Called and returns with the lock held, which is let go while decoding.
+static void run_job(Game *game, LoadJob *job)
+{
+	job->state = JOB_RUNNING;
+	SDL_UnlockMutex(game->loader.lock);
+
+	if (job - game->loader.job < IMAGES) {
+		load_frames(game, job);
+	} else if (SDL_LoadWAV(job->path, &job->audio_spec, &job->wave_buffer, &job->wave_length) == NULL) {
+		fprintf(stderr, "%s: Failed to load %s. %s\n", game->title, job->path, SDL_GetError());
+		job->wave_buffer = NULL;
+	}
+
+	SDL_LockMutex(game->loader.lock);
+	job->state = JOB_DONE;
+	SDL_CondBroadcast(game->loader.job_done);
+}
+
+static LoadJob *find_queued_job(Loader *loader)
+{
+	for (int i = 0; i < loader->job_count; i++) {
+		if (loader->job[i].state == JOB_QUEUED) {
+			return &loader->job[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int decode_thread(void *data)
+{
+	Game *game = data;
+	Loader *loader = &game->loader;
+	LoadJob *job;
+
+	SDL_LockMutex(loader->lock);
+
+	while (!loader->is_stopping) {
+		if ((job = find_queued_job(loader)) != NULL) {
+			run_job(game, job);
+		} else {
+			SDL_CondWait(loader->work_ready, loader->lock);
+		}
+	}
+
+	SDL_UnlockMutex(loader->lock);
+	return 0;
+}
+
+void start_loading(Game *game, SDL_bool load_sounds)
+{
+	Loader *loader = &game->loader;
+	int queued = 0;
+
+	loader->is_stopping = SDL_FALSE;
+	loader->job_count = load_sounds ? IMAGES + SOUNDS : IMAGES;
+	loader->thread_count = 0;
+	open_pack(game, &game->pack, DATADIR"/"PACK_FILE);
+
+	for (int i = 0; i < loader->job_count; i++) {
+		LoadJob *job = &loader->job[i];
+		// The starfield draws the background, so its image is never decoded.
+		SDL_bool is_unused = i == IMAGE_BACKGROUND && game->starfield.is_enabled;
+		job->path = i < IMAGES ? image_path[i] : sound_path[i - IMAGES];
+		job->pack_sprite = i < IMAGES && !is_unused ? find_pack_sprite(&game->pack, strrchr(job->path, '/') + 1) : NULL;
+		job->state = job->pack_sprite != NULL || is_unused ? JOB_DONE : JOB_QUEUED;
+		job->frame_count = 0;
+		job->frame = NULL;
+		job->wave_buffer = NULL;
+
+		if (job->state == JOB_QUEUED) {
+			queued++;
+		}
+	}
+
+	// Load the image libraries now, as loading them on first use from several threads at once would race.
+	IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+	loader->lock = SDL_CreateMutex();
+	loader->job_done = SDL_CreateCond();
+	loader->work_ready = SDL_CreateCond();
+
+	if (loader->lock == NULL || loader->job_done == NULL || loader->work_ready == NULL) {
+		return;
+	}
+
+	int threads = SDL_min(SDL_min(SDL_GetCPUCount(), MAX_LOAD_THREADS), queued);
+
+	while (loader->thread_count < threads) {
+		SDL_Thread *thread = SDL_CreateThread(decode_thread, "loader", game);
+
+		if (thread == NULL) {
+			break;
+		}
+
+		loader->thread[loader->thread_count++] = thread;
+	}
+}
+
+/*
+	Returns whether the image's frames are decoded and waiting to be taken.
+	If they have already been taken, the image is queued to be decoded again
+	in the background. Images held by the asset pack are always ready.
+*/
+SDL_bool prefetch_job(Game *game, int job)
+{
+	LoadJob *load_job = &game->loader.job[job];
+	SDL_bool is_ready = load_job->pack_sprite != NULL;
+
+	SDL_LockMutex(game->loader.lock);
+
+	if (load_job->state == JOB_DONE && load_job->pack_sprite == NULL) {
+		if (load_job->frame_count > 0) {
+			is_ready = SDL_TRUE;
+		} else {
+			load_job->state = JOB_QUEUED;
+			SDL_CondSignal(game->loader.work_ready);
+		}
+	}
+
+	SDL_UnlockMutex(game->loader.lock);
+	return is_ready;
+}
+
+// Returns the finished job, whose results the caller may take.
+LoadJob *wait_for_job(Game *game, int job)
+{
+	LoadJob *load_job = &game->loader.job[job];
+
+	SDL_LockMutex(game->loader.lock);
+
+	// Nothing has claimed the job, so decode it here rather than wait for a thread.
+	if (load_job->state == JOB_QUEUED) {
+		run_job(game, load_job);
+	}
+
+	while (load_job->state != JOB_DONE) {
+		SDL_CondWait(game->loader.job_done, game->loader.lock);
+	}
+
+	SDL_UnlockMutex(game->loader.lock);
+	return load_job;
+}
+
+// Stop the threads, then free whatever results were not taken, and close the pack.
+void finish_loading(Game *game)
+{
+	Loader *loader = &game->loader;
+
+	SDL_LockMutex(loader->lock);
+	loader->is_stopping = SDL_TRUE;
+	SDL_CondBroadcast(loader->work_ready);
+	SDL_UnlockMutex(loader->lock);
+
+	for (int i = 0; i < loader->thread_count; i++) {
+		SDL_WaitThread(loader->thread[i], NULL);
+	}
+
+	for (int i = 0; i < loader->job_count; i++) {
+		LoadJob *job = &loader->job[i];
+
+		for (int f = 0; f < job->frame_count; f++) {
+			SDL_FreeSurface(job->frame[f]);
+		}
+
+		free(job->frame);
+		SDL_FreeWAV(job->wave_buffer);
+	}
+
+	SDL_DestroyCond(loader->work_ready);
+	SDL_DestroyCond(loader->job_done);
+	SDL_DestroyMutex(loader->lock);
+	loader->thread_count = loader->job_count = 0;
+	close_pack(&game->pack);
+}
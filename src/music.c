@@ -0,0 +1,430 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Streams background music from a WAV file, or from Ogg Vorbis when built
+	with libvorbisfile. A thread reads or decodes the file a chunk at a
+	time, converts it to the device's format and rate through an
+	SDL_AudioStream and keeps a small ring of samples topped up for the
+	audio callback, so however long the track is only the chunk, the ring
+	and the stream's own buffers are held in memory. At the end of the data
+	the thread carries on from its start through the same stream, so the
+	track loops without a gap or a click from the resampler.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+#ifdef SHIPXB11_VORBIS
+#include <vorbis/vorbisfile.h>
+
+static const char formats[] = "a WAV file of 8, 16 or 32 bit samples, or Ogg Vorbis";
+#else
+static const char formats[] = "a WAV file of 8, 16 or 32 bit samples";
+#endif
+
+static SDL_bool read_chunk_header(SDL_RWops *file, Uint32 *id, Uint32 *length)
+{
+	Uint32 header[2];
+
+	if (SDL_RWread(file, header, sizeof(header), 1) != 1) {
+		return SDL_FALSE;
+	}
+
+	*id = SDL_SwapLE32(header[0]);
+	*length = SDL_SwapLE32(header[1]);
+	return SDL_TRUE;
+}
+
+static SDL_AudioFormat wav_format(Uint16 tag, Uint16 bits)
+{
+	if (tag == 1 && bits == 8) {
+		return AUDIO_U8;
+	} else if (tag == 1 && bits == 16) {
+		return AUDIO_S16LSB;
+	} else if (tag == 1 && bits == 32) {
+		return AUDIO_S32LSB;
+	} else if (tag == 3 && bits == 32) {
+		return AUDIO_F32LSB;
+	}
+
+	return 0;
+}
+
+// Find the format and the data chunk. Returns 1 if the file is not PCM or float WAV data SDL can convert.
+static int read_wav_header(Music *music, SDL_AudioSpec *spec)
+{
+	SDL_RWops *file = music->file;
+	Uint32 id;
+	Uint32 length;
+
+	SDL_zerop(spec);
+	music->data_length = 0;
+
+	if (!read_chunk_header(file, &id, &length) || id != SDL_FOURCC('R', 'I', 'F', 'F') || SDL_ReadLE32(file) != SDL_FOURCC('W', 'A', 'V', 'E')) {
+		return 1;
+	}
+
+	while (read_chunk_header(file, &id, &length)) {
+		Sint64 start = SDL_RWtell(file);
+
+		if (id == SDL_FOURCC('f', 'm', 't', ' ') && length >= 16) {
+			Uint16 tag = SDL_ReadLE16(file);
+			spec->channels = SDL_ReadLE16(file);
+			spec->freq = SDL_ReadLE32(file);
+			SDL_ReadLE32(file);
+			SDL_ReadLE16(file);
+			Uint16 bits = SDL_ReadLE16(file);
+
+			// WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of its sub format GUID.
+			if (tag == 0xfffe && length >= 26 && SDL_RWseek(file, start + 24, RW_SEEK_SET) >= 0) {
+				tag = SDL_ReadLE16(file);
+			}
+
+			spec->format = wav_format(tag, bits);
+			music->frame_size = spec->channels * bits / 8;
+		} else if (id == SDL_FOURCC('d', 'a', 't', 'a')) {
+			music->data_start = start;
+			// Files written while streaming may not know their length, so trust the file size over the header.
+			music->data_length = SDL_min(length, SDL_RWsize(file) - start);
+		}
+
+		if (spec->format != 0 && music->data_length > 0) {
+			break;
+		}
+
+		// Chunks are padded to an even length.
+		if (SDL_RWseek(file, start + length + (length & 1), RW_SEEK_SET) < 0) {
+			return 1;
+		}
+	}
+
+	if (spec->format == 0 || spec->channels == 0 || spec->freq <= 0 || music->frame_size == 0) {
+		return 1;
+	}
+
+	music->data_length -= music->data_length % music->frame_size;
+	return music->data_length == 0;
+}
+
+// Read a whole chunk, carrying on from the start of the data at its end, so the loop has no gap.
+static int read_wav(Game *game, Music *music)
+{
+	for (Uint32 filled = 0; filled < music->chunk_size;) {
+		Uint32 length = SDL_min(music->chunk_size - filled, music->data_length - music->position);
+
+		if (SDL_RWread(music->file, music->chunk + filled, length, 1) != 1) {
+			fprintf(stderr, "%s: Failed to read the music. %s\n", game->title, SDL_GetError());
+			return 1;
+		}
+
+		filled += length;
+		music->position += length;
+
+		if (music->position == music->data_length) {
+			music->position = 0;
+
+			if (SDL_RWseek(music->file, music->data_start, RW_SEEK_SET) < 0) {
+				fprintf(stderr, "%s: Failed to loop the music. %s\n", game->title, SDL_GetError());
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+#ifdef SHIPXB11_VORBIS
+// libvorbisfile reads through the same SDL_RWops, whose whence values are stdio's.
+static size_t read_file(void *data, size_t size, size_t count, void *file)
+{
+	return SDL_RWread(file, data, size, count);
+}
+
+static int seek_file(void *file, ogg_int64_t offset, int whence)
+{
+	return SDL_RWseek(file, offset, whence) < 0 ? -1 : 0;
+}
+
+static long tell_file(void *file)
+{
+	return (long)SDL_RWtell(file);
+}
+
+// Returns 1 if the file is not Ogg Vorbis, or holds no samples to loop.
+static int open_vorbis(Game *game, Music *music, SDL_AudioSpec *spec)
+{
+	ov_callbacks callbacks = { read_file, seek_file, NULL, tell_file };
+	OggVorbis_File *vorbis = allocate(game, sizeof(OggVorbis_File), __func__);
+	vorbis_info *info;
+
+	if (SDL_RWseek(music->file, 0, RW_SEEK_SET) < 0 || ov_open_callbacks(music->file, vorbis, NULL, 0, callbacks) != 0) {
+		free(vorbis);
+		return 1;
+	}
+
+	info = ov_info(vorbis, -1);
+
+	if (ov_pcm_total(vorbis, -1) <= 0 || info->channels <= 0) {
+		ov_clear(vorbis);
+		free(vorbis);
+		return 1;
+	}
+
+	SDL_zerop(spec);
+	spec->format = AUDIO_S16SYS;
+	spec->channels = info->channels;
+	spec->freq = info->rate;
+	music->frame_size = info->channels * sizeof(Sint16);
+	music->vorbis = vorbis;
+	return 0;
+}
+
+// Decode a whole chunk of 16 bit samples, going back to the first at the end, so the loop has no gap.
+static int read_vorbis(Game *game, Music *music)
+{
+	for (Uint32 filled = 0; filled < music->chunk_size;) {
+		int section;
+		long length = ov_read(music->vorbis, (char *)music->chunk + filled, music->chunk_size - filled, SDL_BYTEORDER == SDL_BIG_ENDIAN, 2, 1, &section);
+
+		if (length == 0 && ov_pcm_seek(music->vorbis, 0) != 0) {
+			fprintf(stderr, "%s: Failed to loop the music.\n", game->title);
+			return 1;
+		} else if (length < 0 && length != OV_HOLE) {
+			fprintf(stderr, "%s: Failed to decode the music.\n", game->title);
+			return 1;
+		}
+
+		// A hole is a gap in the stream, which is skipped.
+		filled += SDL_max(length, 0);
+	}
+
+	return 0;
+}
+#endif
+
+static int read_music(Game *game, Music *music)
+{
+#ifdef SHIPXB11_VORBIS
+	int status = music->vorbis != NULL ? read_vorbis(game, music) : read_wav(game, music);
+#else
+	int status = read_wav(game, music);
+#endif
+
+	if (status != 0) {
+		return 1;
+	}
+
+	if (SDL_AudioStreamPut(music->stream, music->chunk, music->chunk_size) != 0) {
+		fprintf(stderr, "%s: Failed to convert the music. %s\n", game->title, SDL_GetError());
+		return 1;
+	}
+
+	return 0;
+}
+
+// Move converted samples into the ring, up to its end and then round from its start. Returns the samples moved.
+static int fill_ring(Music *music)
+{
+	Uint32 head = SDL_AtomicGet(&music->ring_head);
+	Uint32 tail = SDL_AtomicGet(&music->ring_tail);
+	Uint32 start = tail;
+
+	while (tail - head < MUSIC_RING) {
+		Uint32 index = tail % MUSIC_RING;
+		int span = SDL_min(MUSIC_RING - (tail - head), MUSIC_RING - index);
+		int length = SDL_AudioStreamGet(music->stream, music->ring + index, span * sizeof(Sint16));
+
+		if (length <= 0) {
+			break;
+		}
+
+		tail += length / sizeof(Sint16);
+	}
+
+	// Publish the samples only once they are written.
+	SDL_AtomicSet(&music->ring_tail, tail);
+	return tail - start;
+}
+
+static int decode_music(void *data)
+{
+	Game *game = data;
+	Music *music = &game->audio.music;
+
+	while (!SDL_AtomicGet(&music->is_stopping)) {
+		if (SDL_AudioStreamAvailable(music->stream) < MUSIC_CHUNK && read_music(game, music) != 0) {
+			break;
+		}
+
+		// Sleep once the ring is full, until the callback has played some of it.
+		if (fill_ring(music) == 0) {
+			SDL_SemWait(music->consumed);
+		}
+	}
+
+	return 0;
+}
+
+static int greatest_common_divisor(int a, int b)
+{
+	while (b != 0) {
+		int remainder = a % b;
+		a = b;
+		b = remainder;
+	}
+
+	return a;
+}
+
+static void free_music(Music *music)
+{
+#ifdef SHIPXB11_VORBIS
+	if (music->vorbis != NULL) {
+		ov_clear(music->vorbis);
+		free(music->vorbis);
+	}
+#endif
+
+	SDL_FreeAudioStream(music->stream);
+	SDL_DestroySemaphore(music->consumed);
+	SDL_RWclose(music->file);
+	free(music->chunk);
+	free(music->ring);
+	music->ring = NULL;
+}
+
+// Play the file over and over until stop_music(). Returns 1, with no music, if the file is missing or cannot be streamed.
+int start_music(Game *game, const char *path)
+{
+	Audio *audio = &game->audio;
+	Music *music = &audio->music;
+	SDL_AudioSpec spec;
+	int status;
+
+	if (audio->id == 0 || (music->file = SDL_RWFromFile(path, "rb")) == NULL) {
+		return 1;
+	}
+
+	music->vorbis = NULL;
+
+	if (read_wav_header(music, &spec) == 0) {
+		status = SDL_RWseek(music->file, music->data_start, RW_SEEK_SET) < 0;
+	} else {
+#ifdef SHIPXB11_VORBIS
+		status = open_vorbis(game, music, &spec);
+#else
+		status = 1;
+#endif
+	}
+
+	if (status != 0) {
+		fprintf(stderr, "%s: %s is not %s.\n", game->title, path, formats);
+		SDL_RWclose(music->file);
+		return 1;
+	}
+
+	music->stream = SDL_NewAudioStream(spec.format, spec.channels, spec.freq, audio->device_spec.format, audio->device_spec.channels, audio->device_spec.freq);
+	music->consumed = SDL_CreateSemaphore(0);
+	music->chunk = allocate(game, MUSIC_CHUNK, __func__);
+	music->ring = allocate(game, MUSIC_RING * sizeof(Sint16), __func__);
+	music->position = 0;
+	music->gain = 32767 * MUSIC_GAIN;
+	music->underruns = 0;
+	music->has_started = SDL_FALSE;
+	SDL_AtomicSet(&music->ring_head, 0);
+	SDL_AtomicSet(&music->ring_tail, 0);
+	SDL_AtomicSet(&music->is_stopping, 0);
+
+	/*
+		Read about MUSIC_CHUNK bytes of converted audio at a time, however much
+		the conversion grows the samples. SDL2's stream drops what is left over
+		of an output frame at the end of every put, so read a multiple of the
+		frames that convert to a whole number of output frames.
+	*/
+	int step = spec.freq / greatest_common_divisor(spec.freq, audio->device_spec.freq);
+	Sint64 frames = (Sint64)MUSIC_CHUNK * spec.freq / (audio->device_spec.freq * audio->device_spec.channels * (Sint64)sizeof(Sint16));
+	frames = frames >= step ? frames / step * step : step;
+	music->chunk_size = SDL_min(MUSIC_CHUNK / music->frame_size, frames) * music->frame_size;
+
+	if (music->stream == NULL || music->consumed == NULL) {
+		fprintf(stderr, "%s: Failed to stream %s. %s\n", game->title, path, SDL_GetError());
+		free_music(music);
+		return 1;
+	}
+
+	music->thread = SDL_CreateThread(decode_music, "music", game);
+
+	if (music->thread == NULL) {
+		fprintf(stderr, "%s: Failed to stream %s. %s\n", game->title, path, SDL_GetError());
+		free_music(music);
+		return 1;
+	}
+
+	return 0;
+}
+
+// Called from the audio callback. Adds what the ring holds to count samples of out.
+void mix_music(Music *music, Sint16 *out, int count)
+{
+	if (music->ring == NULL) {
+		return;
+	}
+
+	Uint32 head = SDL_AtomicGet(&music->ring_head);
+	Uint32 tail = SDL_AtomicGet(&music->ring_tail);
+	int available = SDL_min((Uint32)count, tail - head);
+
+	if (available < count && music->has_started) {
+		music->underruns++;
+	}
+
+	music->has_started |= available == count;
+
+	for (int mixed = 0; mixed < available;) {
+		Uint32 index = (head + mixed) % MUSIC_RING;
+		int span = SDL_min(available - mixed, (int)(MUSIC_RING - index));
+		mix_samples(out + mixed, music->ring + index, span, music->gain, music->gain);
+		mixed += span;
+	}
+
+	// Hand the samples back to the decoder only once they are mixed.
+	SDL_AtomicSet(&music->ring_head, head + available);
+	SDL_SemPost(music->consumed);
+}
+
+// The audio device must be closed first, so the callback is no longer reading the ring.
+void stop_music(Game *game)
+{
+	Music *music = &game->audio.music;
+
+	if (music->ring == NULL) {
+		return;
+	}
+
+	SDL_AtomicSet(&music->is_stopping, 1);
+	SDL_SemPost(music->consumed);
+	SDL_WaitThread(music->thread, NULL);
+
+	if (music->underruns > 0) {
+		fprintf(stderr, "%s: The music ran short %d times.\n", game->title, music->underruns);
+	}
+
+	free_music(music);
+}
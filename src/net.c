@@ -0,0 +1,572 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Two player games over UDP, with rollback. Each side runs the whole
+	simulation. Its own input is used NET_INPUT_DELAY ticks after it is
+	read and is sent to the other side with every tick. The other player's
+	input is guessed to be what it last was until it arrives. When it turns
+	out different, the game is put back to a snapshot from before the guess
+	and the ticks since are simulated again, all before the next frame is
+	drawn. A side only waits when it gets NET_ROLLBACK ticks ahead of what
+	it has heard.
+
+	Every packet carries all the input the other side has not acknowledged,
+	so a lost packet is made up for by the next one. The host picks the
+	seed and the number of aliens, and is player 1.
+*/
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shipxb11.h"
+
+enum {
+	PACKET_HELLO, // Joining side: version.
+	PACKET_WELCOME, // Host: version, seed, aliens of each type.
+	PACKET_INPUT, // First tick, ticks heard, count, then an input byte per tick.
+	PACKET_BYE
+};
+
+#ifdef _WIN32
+#define close_socket closesocket
+#else
+#define close_socket close
+#endif
+
+static void put_uint32(Uint8 *data, Uint32 value)
+{
+	data[0] = value >> 24;
+	data[1] = value >> 16;
+	data[2] = value >> 8;
+	data[3] = value;
+}
+
+static Uint32 get_uint32(const Uint8 *data)
+{
+	return (Uint32)data[0] << 24 | (Uint32)data[1] << 16 | (Uint32)data[2] << 8 | data[3];
+}
+
+static void send_now(NetSession *net, const Uint8 *data, int length)
+{
+	struct sockaddr_in address;
+	SDL_zero(address);
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = net->peer_host;
+	address.sin_port = net->peer_port;
+	sendto(net->socket, (const char *)data, length, 0, (struct sockaddr *)&address, sizeof(address));
+}
+
+// Drop or hold back the packet as -L and -D ask, otherwise send it straight away.
+static void send_packet(NetSession *net, const Uint8 *data, int length)
+{
+	if (net->loss > 0 && (int)(xorshift32(&net->random_state) % 100) < net->loss) {
+		net->dropped++;
+		return;
+	}
+
+	if (net->latency == 0 || net->queue_count == NET_QUEUE) {
+		send_now(net, data, length);
+		return;
+	}
+
+	NetPacket *packet = &net->queue[net->queue_count++];
+	memcpy(packet->data, data, length);
+	packet->length = length;
+	packet->due = SDL_GetTicks() + net->latency;
+}
+
+static void flush_queue(NetSession *net)
+{
+	Uint32 now = SDL_GetTicks();
+	int sent = 0;
+
+	while (sent < net->queue_count && (Sint32)(now - net->queue[sent].due) >= 0) {
+		send_now(net, net->queue[sent].data, net->queue[sent].length);
+		sent++;
+	}
+
+	memmove(net->queue, net->queue + sent, (net->queue_count - sent) * sizeof(NetPacket));
+	net->queue_count -= sent;
+}
+
+// Everything the other side has not acknowledged, up to NET_INPUTS ticks of it.
+static int pack_inputs(NetSession *net, Uint8 *data)
+{
+	long count = SDL_min(net->local_end - net->peer_ack, NET_INPUTS);
+
+	data[0] = PACKET_INPUT;
+	put_uint32(data + 1, net->peer_ack);
+	put_uint32(data + 5, net->remote_end);
+	data[9] = count;
+
+	for (long i = 0; i < count; i++) {
+		data[10 + i] = net->input[net->local][(net->peer_ack + i) % NET_INPUTS];
+	}
+
+	return 10 + count;
+}
+
+static void send_inputs(NetSession *net)
+{
+	Uint8 data[NET_PACKET_SIZE];
+	int length = pack_inputs(net, data);
+
+	send_packet(net, data, length);
+	net->last_sent = SDL_GetTicks();
+}
+
+static void send_welcome(Game *game, NetSession *net)
+{
+	Uint8 data[14];
+	data[0] = PACKET_WELCOME;
+	data[1] = NET_VERSION;
+	put_uint32(data + 2, net->seed >> 32);
+	put_uint32(data + 6, net->seed);
+	put_uint32(data + 10, game->alien_count);
+	send_packet(net, data, sizeof(data));
+}
+
+// Take the other player's input in tick order. A gap means a lost packet, which a later one fills.
+static void read_inputs(NetSession *net, const Uint8 *data, int length)
+{
+	int remote = 1 - net->local;
+	long start = get_uint32(data + 1);
+	long ack = get_uint32(data + 5);
+	int count = SDL_min(data[9], length - 10);
+
+	net->peer_ack = SDL_max(net->peer_ack, SDL_min(ack, net->local_end));
+
+	for (long tick = SDL_max(start, net->remote_end); tick < start + count; tick++) {
+		Uint8 *input = &net->input[remote][tick % NET_INPUTS];
+
+		// Keep clear of the inputs a rollback may still need.
+		if (tick != net->remote_end || tick >= net->tick + NET_INPUTS - NET_ROLLBACK - 1) {
+			break;
+		}
+
+		if (tick < net->tick && *input != data[10 + tick - start] && (net->first_wrong < 0 || tick < net->first_wrong)) {
+			net->first_wrong = tick;
+		}
+
+		*input = data[10 + tick - start];
+		net->remote_end++;
+	}
+}
+
+// Returns 1 if the other player has left.
+static int receive_packets(Game *game, NetSession *net)
+{
+	Uint8 data[NET_PACKET_SIZE];
+	struct sockaddr_in address;
+	socklen_t address_length = sizeof(address);
+	int length;
+
+	while ((length = recvfrom(net->socket, (char *)data, sizeof(data), 0, (struct sockaddr *)&address, &address_length)) > 0) {
+		if (address.sin_addr.s_addr != net->peer_host || address.sin_port != net->peer_port) {
+			address_length = sizeof(address);
+			continue;
+		}
+
+		net->last_heard = SDL_GetTicks();
+
+		if (data[0] == PACKET_BYE) {
+			return 1;
+		} else if (data[0] == PACKET_INPUT && length >= 10) {
+			read_inputs(net, data, length);
+		} else if (data[0] == PACKET_HELLO && net->is_host) {
+			// The welcome was lost, the game has started anyway.
+			send_welcome(game, net);
+		}
+
+		address_length = sizeof(address);
+	}
+
+	return 0;
+}
+
+static int open_socket(Game *game, NetSession *net, int port)
+{
+	struct sockaddr_in address;
+
+#ifdef _WIN32
+	WSADATA wsa_data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+		fprintf(stderr, "%s: Failed to start Winsock.\n", game->title);
+		return 1;
+	}
+#endif
+
+	net->socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (net->socket < 0) {
+		fprintf(stderr, "%s: Failed to open a UDP socket.\n", game->title);
+		return 1;
+	}
+
+	SDL_zero(address);
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (bind(net->socket, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		fprintf(stderr, "%s: Failed to use UDP port %d.\n", game->title, port);
+		close_socket(net->socket);
+		return 1;
+	}
+
+#ifdef _WIN32
+	u_long non_blocking = 1;
+	ioctlsocket(net->socket, FIONBIO, &non_blocking);
+#else
+	fcntl(net->socket, F_SETFL, fcntl(net->socket, F_GETFL) | O_NONBLOCK);
+#endif
+	return 0;
+}
+
+static int resolve_address(Game *game, NetSession *net)
+{
+	char host[256];
+	const char *colon = strrchr(net->address, ':');
+	struct addrinfo hints;
+	struct addrinfo *result;
+
+	if (colon == NULL || colon - net->address >= (int)sizeof(host) || atoi(colon + 1) <= 0) {
+		fprintf(stderr, "%s: %s is not a host:port to join.\n", game->title, net->address);
+		return 1;
+	}
+
+	memcpy(host, net->address, colon - net->address);
+	host[colon - net->address] = '\0';
+	SDL_zero(hints);
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+		fprintf(stderr, "%s: Failed to look up %s.\n", game->title, host);
+		return 1;
+	}
+
+	net->peer_host = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+	net->peer_port = htons(atoi(colon + 1));
+	freeaddrinfo(result);
+	return 0;
+}
+
+// Wait for a HELLO, and answer it with the seed and aliens of the game.
+static int wait_for_player(Game *game, NetSession *net)
+{
+	Uint8 data[NET_PACKET_SIZE];
+	struct sockaddr_in address;
+	Uint32 start = SDL_GetTicks();
+
+	fprintf(stderr, "%s: Waiting for the other player on port %d.\n", game->title, net->port);
+
+	while (SDL_GetTicks() - start < NET_CONNECT_TIMEOUT) {
+		socklen_t address_length = sizeof(address);
+		int length = recvfrom(net->socket, (char *)data, sizeof(data), 0, (struct sockaddr *)&address, &address_length);
+
+		if (length >= 2 && data[0] == PACKET_HELLO && data[1] == NET_VERSION) {
+			net->peer_host = address.sin_addr.s_addr;
+			net->peer_port = address.sin_port;
+			send_welcome(game, net);
+			seed_random(game, net->seed);
+			return 0;
+		}
+
+		SDL_Delay(10);
+	}
+
+	fprintf(stderr, "%s: No one joined.\n", game->title);
+	return 1;
+}
+
+// Say HELLO until the host answers, then take its seed and aliens.
+static int join_game(Game *game, NetSession *net)
+{
+	Uint8 data[NET_PACKET_SIZE];
+	Uint8 hello[2] = { PACKET_HELLO, NET_VERSION };
+	Uint32 start = SDL_GetTicks();
+
+	if (resolve_address(game, net) != 0) {
+		return 1;
+	}
+
+	for (int i = 0; SDL_GetTicks() - start < NET_CONNECT_TIMEOUT; i++) {
+		if (i % 25 == 0) {
+			send_packet(net, hello, sizeof(hello));
+		}
+
+		flush_queue(net);
+		int length = recvfrom(net->socket, (char *)data, sizeof(data), 0, NULL, NULL);
+
+		if (length >= 14 && data[0] == PACKET_WELCOME) {
+			Uint32 aliens = get_uint32(data + 10);
+
+			if (data[1] != NET_VERSION || aliens < 1 || aliens > MAX_ALIEN_POPULATION) {
+				fprintf(stderr, "%s: The game at %s is from another version.\n", game->title, net->address);
+				return 1;
+			}
+
+			seed_random(game, (Uint64)get_uint32(data + 2) << 32 | get_uint32(data + 6));
+			game->alien_count = aliens;
+			return 0;
+		}
+
+		SDL_Delay(10);
+	}
+
+	fprintf(stderr, "%s: No answer from %s.\n", game->title, net->address);
+	return 1;
+}
+
+/*
+	Host a game on net->port or join the one at net->address, if either is
+	set. Either way the game is seeded, the host from seed and the joining
+	side from the host, so call it before init_sprites().
+*/
+int connect_net(Game *game, Uint64 seed)
+{
+	NetSession *net = &game->net;
+
+	if (!net->is_active) {
+		return 0;
+	}
+
+	net->seed = seed;
+	net->random_state = (Uint32)seed * 2654435761u + 1;
+	net->queue_count = 0;
+	net->dropped = 0;
+
+	if (open_socket(game, net, net->is_host ? net->port : 0) != 0) {
+		return 1;
+	}
+
+	int status = net->is_host ? wait_for_player(game, net) : join_game(game, net);
+
+	if (status != 0) {
+		close_socket(net->socket);
+		net->is_active = SDL_FALSE;
+	}
+
+	return status;
+}
+
+// Once the sprites are loaded, add the second ship and start the game with no input for the first ticks.
+int start_net_game(Game *game)
+{
+	NetSession *net = &game->net;
+
+	if (!net->is_active) {
+		return 0;
+	}
+
+	set_players(game, PLAYERS);
+	init_snapshot(game);
+	net->state = malloc((NET_ROLLBACK + 1) * game->snapshot.size);
+
+	if (net->state == NULL) {
+		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+
+	memset(net->input, NO_KEY, sizeof(net->input));
+	net->local = net->is_host ? 0 : 1;
+	net->tick = 0;
+	net->local_end = net->remote_end = net->peer_ack = NET_INPUT_DELAY;
+	net->first_wrong = -1;
+	net->restart = SDL_FALSE;
+	net->last_heard = net->last_sent = SDL_GetTicks();
+	net->rollbacks = net->resimulated = net->stalls = 0;
+	game->paused = SDL_FALSE;
+	return 0;
+}
+
+static Uint8 *tick_state(Game *game, long tick)
+{
+	return game->net.state + tick % (NET_ROLLBACK + 1) * game->snapshot.size;
+}
+
+// Save the state before the tick, then run it on the inputs known or guessed for it.
+static void simulate_tick(Game *game, NetSession *net, long tick)
+{
+	int remote = 1 - net->local;
+	SDL_bool restart = SDL_FALSE;
+
+	save_snapshot(game, tick_state(game, tick));
+
+	// Guess the other player is holding the same keys, but not tapping fire or restarting again.
+	if (tick >= net->remote_end) {
+		net->input[remote][tick % NET_INPUTS] = net->input[remote][(net->remote_end - 1) % NET_INPUTS] & ~(TAP_KEY | REPLAY_RESTART);
+	}
+
+	for (int i = 0; i < PLAYERS; i++) {
+		restart |= (net->input[i][tick % NET_INPUTS] & REPLAY_RESTART) != 0;
+	}
+
+	if (restart) {
+		reset_game(game);
+	}
+
+	for (int i = 0; i < PLAYERS; i++) {
+		game->player[i].key = net->input[i][tick % NET_INPUTS] & REPLAY_KEYS;
+	}
+
+	update_game(game);
+}
+
+// Go back to the first tick that was run on a wrong guess and run the ticks since again, silently.
+static void roll_back(Game *game, NetSession *net)
+{
+	if (net->first_wrong < 0) {
+		return;
+	}
+
+	load_snapshot(game, tick_state(game, net->first_wrong));
+	game->audio.is_muted = SDL_TRUE;
+
+	for (long tick = net->first_wrong; tick < net->tick; tick++) {
+		simulate_tick(game, net, tick);
+		net->resimulated++;
+	}
+
+	game->audio.is_muted = SDL_FALSE;
+	net->rollbacks++;
+	net->first_wrong = -1;
+}
+
+/*
+	Use in place of update_game(). game->player[net->local].key is the
+	keyboard, and is kept as it was. Returns 1 if a tick was run, 0 if the
+	game must wait for the other player, or -1 if they have gone.
+*/
+int net_tick(Game *game)
+{
+	NetSession *net = &game->net;
+	unsigned int key = game->player[net->local].key;
+	int status = 1;
+
+	if (receive_packets(game, net) != 0) {
+		fprintf(stderr, "%s: The other player has left.\n", game->title);
+		return -1;
+	}
+
+	if (SDL_GetTicks() - net->last_heard > NET_TIMEOUT) {
+		fprintf(stderr, "%s: Lost touch with the other player.\n", game->title);
+		return -1;
+	}
+
+	roll_back(game, net);
+
+	if (net->tick - net->remote_end >= NET_ROLLBACK) {
+		net->stalls++;
+		status = 0;
+	} else {
+		net->input[net->local][net->local_end % NET_INPUTS] = (key & REPLAY_KEYS) | (net->restart ? REPLAY_RESTART : 0);
+		net->local_end++;
+		net->restart = SDL_FALSE;
+		key &= ~TAP_KEY;
+		simulate_tick(game, net, net->tick);
+		net->tick++;
+	}
+
+	if (status == 1 || SDL_GetTicks() - net->last_sent >= NET_RESEND_MS) {
+		send_inputs(net);
+	}
+
+	flush_queue(net);
+	game->player[net->local].key = key;
+	return status;
+}
+
+/*
+	At the end of a headless run, wait for the other player's input for
+	every tick that was run, and correct the game to it, and make sure they
+	have this side's. Returns 1 if they went quiet first.
+*/
+int settle_net(Game *game)
+{
+	NetSession *net = &game->net;
+	Uint8 data[NET_PACKET_SIZE];
+
+	for (;;) {
+		// Their last input may come just before they say goodbye.
+		int has_left = receive_packets(game, net);
+
+		if (net->remote_end >= net->tick && net->peer_ack >= net->tick) {
+			break;
+		}
+
+		if (has_left || SDL_GetTicks() - net->last_heard > NET_TIMEOUT) {
+			fprintf(stderr, "%s: The other player stopped before the end.\n", game->title);
+			return 1;
+		}
+
+		if (SDL_GetTicks() - net->last_sent >= NET_RESEND_MS) {
+			send_inputs(net);
+		}
+
+		flush_queue(net);
+		SDL_Delay(1);
+	}
+
+	roll_back(game, net);
+
+	// Tell them everything arrived, past any simulated loss, as they may still be waiting to hear it.
+	int length = pack_inputs(net, data);
+
+	for (int i = 0; i < 3; i++) {
+		send_now(net, data, length);
+	}
+
+	return 0;
+}
+
+void close_net(Game *game)
+{
+	NetSession *net = &game->net;
+	Uint8 bye = PACKET_BYE;
+
+	if (!net->is_active) {
+		return;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		send_now(net, &bye, 1);
+	}
+
+	fprintf(stderr, "%s: %ld ticks, %ld rollbacks simulating %ld ticks again, waited %ld times, dropped %ld packets.\n", game->title, net->tick, net->rollbacks, net->resimulated, net->stalls, net->dropped);
+	close_socket(net->socket);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	free(net->state);
+	net->is_active = SDL_FALSE;
+}
@@ -0,0 +1,206 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Paces the frames to the display's refresh rate, or to the -f rate. At
+	the display's rate the renderer is asked for vsync, and the present does
+	the waiting, though some drivers say they sync and do not, so that is
+	checked. Otherwise each frame is due one period after the last was due,
+	and is waited for with a sleep to just short of it, then a spin. How late
+	sleeps wake is measured as they happen, which keeps the spin as short as
+	the OS timer allows. How far each frame starts off the beat is kept for
+	the statistics -P prints on exit.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+static Uint64 ms_to_ticks(double ms)
+{
+	return ms * SDL_GetPerformanceFrequency() / 1000;
+}
+
+static double ticks_to_ms(Sint64 ticks)
+{
+	return ticks * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Sleep for the whole milliseconds in ticks, but never more than a frame. Returns how much later than that it woke.
+static Sint64 sleep_for(Pacer *pacer, Uint64 ticks)
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+	Uint32 ms = (pacer->period > 0 ? SDL_min(ticks, pacer->period) : ticks) * 1000 / SDL_GetPerformanceFrequency();
+	SDL_Delay(ms);
+	return (Sint64)(SDL_GetPerformanceCounter() - start - ms_to_ticks(ms));
+}
+
+// Spin for as long as sleeps wake late, and a quarter of a millisecond more, but never a whole frame.
+static void set_spin(Pacer *pacer, Sint64 late)
+{
+	Uint64 spin = SDL_max(late, 0) + ms_to_ticks(0.25);
+	pacer->spin = pacer->period > 0 ? SDL_min(spin, pacer->period) : spin;
+}
+
+/*
+	Find the display's refresh rate and the rate to pace to, and time a few
+	short sleeps to start the spin from. Call once the window is made.
+	Returns the flags to create the renderer with.
+*/
+Uint32 init_pacer(Game *game)
+{
+	Pacer *pacer = &game->pacer;
+	SDL_DisplayMode mode;
+	int display = SDL_GetWindowDisplayIndex(game->window);
+	Sint64 late = 0;
+
+	pacer->refresh_rate = display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 ? mode.refresh_rate : 0;
+	pacer->rate = game->frame_rate >= 0 ? game->frame_rate : pacer->refresh_rate > 0 ? pacer->refresh_rate : FPS;
+	pacer->period = pacer->rate > 0 ? SDL_GetPerformanceFrequency() / pacer->rate : 0;
+	pacer->has_vsync = SDL_FALSE;
+	pacer->short_presents = 0;
+	pacer->frames = pacer->missed = 0;
+	pacer->jitter_total = pacer->jitter_max = 0.0;
+
+	for (int i = 0; i < 5; i++) {
+		late = SDL_max(late, sleep_for(pacer, ms_to_ticks(1)));
+	}
+
+	set_spin(pacer, late);
+	return pacer->rate > 0 && pacer->rate == pacer->refresh_rate ? SDL_RENDERER_PRESENTVSYNC : 0;
+}
+
+// Call once the renderer is made, and again whenever frames start after a pause.
+void start_pacer(Game *game)
+{
+	Pacer *pacer = &game->pacer;
+	SDL_RendererInfo info;
+
+	if (pacer->frames == 0) {
+		pacer->has_vsync = pacer->rate > 0 && pacer->rate == pacer->refresh_rate && SDL_GetRendererInfo(game->renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+	}
+
+	pacer->last_frame = pacer->deadline = SDL_GetPerformanceCounter();
+}
+
+static void record_frame(Pacer *pacer, Sint64 offset)
+{
+	double jitter = ticks_to_ms(offset < 0 ? -offset : offset);
+	pacer->jitter[pacer->frames % PACER_HISTORY] = jitter;
+	pacer->jitter_total += jitter;
+	pacer->jitter_max = SDL_max(pacer->jitter_max, jitter);
+	pacer->frames++;
+}
+
+static void wait_until(Pacer *pacer, Uint64 deadline)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	// Signed, as the deadline may have passed since the caller looked.
+	if ((Sint64)(deadline - now) <= 0) {
+		return;
+	}
+
+	// Waking later than expected lengthens the spin straight away, waking sooner shortens it a little at a time.
+	if (deadline - now > pacer->spin) {
+		Sint64 late = sleep_for(pacer, deadline - pacer->spin - now);
+		Uint64 spin = pacer->spin;
+		set_spin(pacer, late);
+
+		if (pacer->spin < spin) {
+			pacer->spin = spin - (spin - pacer->spin) / 16;
+		}
+	}
+
+	while (SDL_GetPerformanceCounter() < deadline) {
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+		SDL_CPUPauseInstruction();
+#endif
+	}
+}
+
+// With vsync a present comes back a refresh after the last. If they keep coming back sooner, nothing is waiting for the display.
+static void check_vsync(Game *game, Uint64 interval)
+{
+	Pacer *pacer = &game->pacer;
+	pacer->short_presents = interval < pacer->period / 2 ? pacer->short_presents + 1 : 0;
+
+	if (pacer->short_presents == PACER_SHORT_PRESENTS) {
+		fprintf(stderr, "%s: The renderer does not wait for vsync, so frames are paced without it.\n", game->title);
+		pacer->has_vsync = SDL_FALSE;
+	}
+}
+
+// Call after each present. Waits until the next frame is due, unless the present already has.
+void pace_frame(Game *game)
+{
+	Pacer *pacer = &game->pacer;
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	if (pacer->rate == 0) {
+		record_frame(pacer, 0);
+		pacer->last_frame = now;
+		return;
+	}
+
+	if (pacer->has_vsync) {
+		Uint64 interval = now - pacer->last_frame;
+		pacer->missed += interval > pacer->period * 3 / 2;
+		record_frame(pacer, interval - pacer->period);
+		check_vsync(game, interval);
+		pacer->last_frame = pacer->deadline = now;
+		return;
+	}
+
+	// A frame more than a period late starts the beat again rather than rushing to catch up.
+	if (now > pacer->deadline) {
+		pacer->missed++;
+
+		if (now - pacer->deadline > pacer->period) {
+			pacer->deadline = now;
+		}
+	} else {
+		wait_until(pacer, pacer->deadline);
+	}
+
+	pacer->last_frame = SDL_GetPerformanceCounter();
+	record_frame(pacer, pacer->last_frame - pacer->deadline);
+	pacer->deadline += pacer->period;
+}
+
+static int compare_floats(const void *p1, const void *p2)
+{
+	float f1 = *(const float *)p1;
+	float f2 = *(const float *)p2;
+	return (f1 > f2) - (f1 < f2);
+}
+
+void print_pacer_stats(Game *game)
+{
+	Pacer *pacer = &game->pacer;
+	float recent[PACER_HISTORY];
+	int count = SDL_min(pacer->frames, PACER_HISTORY);
+
+	if (!pacer->show_stats || pacer->frames == 0) {
+		return;
+	}
+
+	SDL_memcpy(recent, pacer->jitter, sizeof(float) * count);
+	qsort(recent, count, sizeof(float), compare_floats);
+	fprintf(stderr, "%s: %ld frames paced to %d fps %s (display %d Hz), %ld missed. Jitter %.3f ms on average, %.3f ms at most, %.3f ms at the 99th percentile of the last %d.\n", game->title, pacer->frames, pacer->rate, pacer->has_vsync ? "by vsync" : "by timer", pacer->refresh_rate, pacer->missed, pacer->jitter_total / pacer->frames, pacer->jitter_max, recent[(count - 1) * 99 / 100], count);
+}
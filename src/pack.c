@@ -0,0 +1,167 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Reads the asset pack made by shipxb11-pack. The file is mapped rather
+	than read where the system allows, and the sprite loader makes surfaces
+	over the mapped pixels, so nothing is decoded or copied until the atlas
+	pages are filled.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "shipxb11.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+static int map_pack(AssetPack *pack, const char *path)
+{
+#ifdef HAVE_MMAP
+	struct stat info;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		return 1;
+	}
+
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return 1;
+	}
+
+	void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		return 1;
+	}
+
+	pack->data = data;
+	pack->size = info.st_size;
+	pack->is_mapped = SDL_TRUE;
+#else
+	pack->data = SDL_LoadFile(path, &pack->size);
+	pack->is_mapped = SDL_FALSE;
+#endif
+	return pack->data == NULL;
+}
+
+// Check every count and offset against the file size, so that a truncated or stale pack cannot be read past its end.
+static SDL_bool is_valid_pack(AssetPack *pack)
+{
+	PackHeader *header = pack->header;
+
+	if (pack->size < sizeof(PackHeader) || memcmp(header->magic, PACK_MAGIC, sizeof(header->magic)) != 0 || header->version != PACK_VERSION) {
+		return SDL_FALSE;
+	}
+
+	Uint64 table_size = (Uint64)header->sprite_count * sizeof(PackSprite) + (Uint64)header->image_count * sizeof(PackImage);
+
+	if (table_size > pack->size - sizeof(PackHeader)) {
+		return SDL_FALSE;
+	}
+
+	pack->sprite = (PackSprite *)(header + 1);
+	pack->image = (PackImage *)(pack->sprite + header->sprite_count);
+
+	for (Uint32 i = 0; i < header->sprite_count; i++) {
+		PackSprite *sprite = &pack->sprite[i];
+
+		if (sprite->name[PACK_NAME_SIZE - 1] != '\0' || sprite->frame_count == 0 || sprite->first_image > header->image_count || sprite->frame_count > header->image_count - sprite->first_image) {
+			return SDL_FALSE;
+		}
+	}
+
+	for (Uint32 i = 0; i < header->image_count; i++) {
+		PackImage *image = &pack->image[i];
+
+		if (image->width == 0 || image->height == 0 || image->pitch < image->width * 4 || image->offset % PACK_ALIGN != 0) {
+			return SDL_FALSE;
+		}
+
+		if (image->offset > pack->size || (Uint64)image->pitch * image->height > pack->size - image->offset) {
+			return SDL_FALSE;
+		}
+
+		if (image->format != SDL_PIXELFORMAT_RGBA32 && image->format != SDL_PIXELFORMAT_RGB888) {
+			return SDL_FALSE;
+		}
+	}
+
+	return SDL_TRUE;
+}
+
+// Returns 0 with the pack open, or 1 if there is no usable pack, in which case the loose files are used.
+int open_pack(Game *game, AssetPack *pack, const char *path)
+{
+	pack->data = NULL;
+
+	if (map_pack(pack, path) != 0) {
+		return 1;
+	}
+
+	pack->header = (PackHeader *)pack->data;
+
+	if (!is_valid_pack(pack)) {
+		fprintf(stderr, "%s: Ignoring %s, it is not a valid asset pack.\n", game->title, path);
+		close_pack(pack);
+		return 1;
+	}
+
+	return 0;
+}
+
+void close_pack(AssetPack *pack)
+{
+	if (pack->data == NULL) {
+		return;
+	}
+
+#ifdef HAVE_MMAP
+	if (pack->is_mapped) {
+		munmap(pack->data, pack->size);
+	}
+#endif
+
+	if (!pack->is_mapped) {
+		SDL_free(pack->data);
+	}
+
+	pack->data = NULL;
+}
+
+PackSprite *find_pack_sprite(AssetPack *pack, const char *name)
+{
+	if (pack->data == NULL) {
+		return NULL;
+	}
+
+	for (Uint32 i = 0; i < pack->header->sprite_count; i++) {
+		if (strncmp(pack->sprite[i].name, name, PACK_NAME_SIZE) == 0) {
+			return &pack->sprite[i];
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,259 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	shipxb11-pack decodes the sprite frames in a data directory and writes
+	them to one asset pack, so the game can start without decoding images.
+	Frames are found the way the game's loose file loader finds them: name00,
+	name01 and so on until one is missing.
+*/
+
+#include <SDL2/SDL_image.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shipxb11.h"
+
+typedef struct {
+	int sprite_count;
+	int image_count;
+	PackSprite *sprite;
+	PackImage *image;
+	SDL_Surface **surface;
+} Pack;
+
+static void *resize(void *block, size_t size)
+{
+	block = realloc(block, size);
+
+	if (block == NULL) {
+		fprintf(stderr, "%s: realloc returned NULL in function %s\n", GAME_TITLE, __func__);
+		exit(1);
+	}
+
+	return block;
+}
+
+// Split "bigblue07.png" into the sprite name "bigblue.png", or return 1 if the file is not a frame.
+static int sprite_name(const char *filename, char *name)
+{
+	const char *ext = strrchr(filename, '.');
+
+	if (ext == NULL || (strcmp(ext, ".png") != 0 && strcmp(ext, ".jpg") != 0)) {
+		return 1;
+	}
+
+	int stem = ext - filename - 2;
+
+	if (stem < 1 || !isdigit((unsigned char)filename[stem]) || !isdigit((unsigned char)filename[stem + 1]) || stem + strlen(ext) >= PACK_NAME_SIZE) {
+		return 1;
+	}
+
+	memcpy(name, filename, stem);
+	strcpy(name + stem, ext);
+	return 0;
+}
+
+static SDL_bool has_sprite(Pack *pack, const char *name)
+{
+	for (int i = 0; i < pack->sprite_count; i++) {
+		if (strcmp(pack->sprite[i].name, name) == 0) {
+			return SDL_TRUE;
+		}
+	}
+
+	return SDL_FALSE;
+}
+
+// Decode an image to the 32 bit format the game's atlas pages use, keeping whether it has alpha.
+static SDL_Surface *decode_frame(const char *path)
+{
+	SDL_Surface *surface = IMG_Load(path);
+
+	if (surface == NULL) {
+		return NULL;
+	}
+
+	SDL_bool opaque = surface->format->Amask == 0 && surface->format->palette == NULL;
+	SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, opaque ? SDL_PIXELFORMAT_RGB888 : SDL_PIXELFORMAT_RGBA32, 0);
+	SDL_FreeSurface(surface);
+
+	if (converted == NULL) {
+		fprintf(stderr, "%s: %s\n", GAME_TITLE, SDL_GetError());
+	}
+
+	return converted;
+}
+
+static void add_sprite(Pack *pack, const char *name)
+{
+	pack->sprite = resize(pack->sprite, sizeof(PackSprite) * (pack->sprite_count + 1));
+	memset(&pack->sprite[pack->sprite_count], 0, sizeof(PackSprite));
+	strcpy(pack->sprite[pack->sprite_count].name, name);
+	pack->sprite_count++;
+}
+
+static int add_frames(Pack *pack, PackSprite *sprite, const char *directory)
+{
+	const char *ext = strrchr(sprite->name, '.');
+	char path[FILENAME_MAX];
+	SDL_Surface *surface;
+
+	sprite->first_image = pack->image_count;
+
+	for (;;) {
+		snprintf(path, sizeof(path), "%s/%.*s%02u%s", directory, (int)(ext - sprite->name), sprite->name, sprite->frame_count, ext);
+
+		if ((surface = decode_frame(path)) == NULL) {
+			break;
+		}
+
+		pack->image = resize(pack->image, sizeof(PackImage) * (pack->image_count + 1));
+		pack->surface = resize(pack->surface, sizeof(SDL_Surface *) * (pack->image_count + 1));
+		pack->image[pack->image_count].width = surface->w;
+		pack->image[pack->image_count].height = surface->h;
+		pack->image[pack->image_count].pitch = surface->w * 4;
+		pack->image[pack->image_count].format = surface->format->format;
+		pack->surface[pack->image_count] = surface;
+		pack->image_count++;
+		sprite->frame_count++;
+	}
+
+	// A sprite whose first frame is missing, e.g. from a lone name01.png, cannot be loaded by the game either.
+	if (sprite->frame_count == 0) {
+		fprintf(stderr, "%s: Failed to load %s.\n", GAME_TITLE, path);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int compare_sprites(const void *p1, const void *p2)
+{
+	return strcmp(((const PackSprite *)p1)->name, ((const PackSprite *)p2)->name);
+}
+
+static int read_directory(Pack *pack, const char *directory)
+{
+	DIR *dir = opendir(directory);
+	struct dirent *entry;
+	char name[PACK_NAME_SIZE];
+
+	if (dir == NULL) {
+		fprintf(stderr, "%s: Failed to open %s.\n", GAME_TITLE, directory);
+		return 1;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (sprite_name(entry->d_name, name) == 0 && !has_sprite(pack, name)) {
+			add_sprite(pack, name);
+		}
+	}
+
+	closedir(dir);
+
+	// The directory order depends on the file system, so sort for a reproducible pack.
+	qsort(pack->sprite, pack->sprite_count, sizeof(PackSprite), compare_sprites);
+
+	for (int i = 0; i < pack->sprite_count; i++) {
+		if (add_frames(pack, &pack->sprite[i], directory) != 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static Uint64 align(Uint64 offset)
+{
+	return (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+}
+
+static int write_pack(Pack *pack, const char *path)
+{
+	static const char padding[PACK_ALIGN];
+	PackHeader header;
+	FILE *file = fopen(path, "wb");
+
+	if (file == NULL) {
+		fprintf(stderr, "%s: Failed to create %s.\n", GAME_TITLE, path);
+		return 1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.version = PACK_VERSION;
+	header.sprite_count = pack->sprite_count;
+	header.image_count = pack->image_count;
+	Uint64 offset = sizeof(header) + sizeof(PackSprite) * pack->sprite_count + sizeof(PackImage) * pack->image_count;
+
+	for (int i = 0; i < pack->image_count; i++) {
+		pack->image[i].offset = offset = align(offset);
+		offset += (Uint64)pack->image[i].pitch * pack->image[i].height;
+	}
+
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(pack->sprite, sizeof(PackSprite), pack->sprite_count, file);
+	fwrite(pack->image, sizeof(PackImage), pack->image_count, file);
+
+	for (int i = 0; i < pack->image_count; i++) {
+		SDL_Surface *surface = pack->surface[i];
+		fwrite(padding, 1, pack->image[i].offset - ftell(file), file);
+
+		for (int y = 0; y < surface->h; y++) {
+			fwrite((Uint8 *)surface->pixels + y * surface->pitch, 1, pack->image[i].pitch, file);
+		}
+	}
+
+	int status = ferror(file);
+
+	if (fclose(file) != 0 || status != 0) {
+		fprintf(stderr, "%s: Failed to write %s.\n", GAME_TITLE, path);
+		remove(path);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	Pack pack = { 0, 0, NULL, NULL, NULL };
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s data-directory pack-file\n", argv[0]);
+		return 1;
+	}
+
+	int status = read_directory(&pack, argv[1]);
+
+	if (status == 0) {
+		status = write_pack(&pack, argv[2]);
+	}
+
+	for (int i = 0; i < pack.image_count; i++) {
+		SDL_FreeSurface(pack.surface[i]);
+	}
+
+	free(pack.sprite);
+	free(pack.image);
+	free(pack.surface);
+	return status;
+}
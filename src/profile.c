@@ -0,0 +1,182 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Frame profiler, only built with -DSHIPXB11_PROFILE. Zones are kept in a
+	ring of the last PROFILE_EVENTS, which F2 writes out as a Chrome trace
+	(open it in chrome://tracing or ui.perfetto.dev). F1 shows a graph of the
+	last PROFILE_FRAMES frame times, with a line at the frame rate limit.
+*/
+
+#include <stdio.h>
+#include "shipxb11.h"
+
+void init_profiler(Game *game)
+{
+	Profiler *profiler = &game->profiler;
+
+	for (int i = 0; i < PROFILE_EVENTS; i++) {
+		SDL_AtomicSet(&profiler->event[i].sequence, -1);
+	}
+
+	for (int i = 0; i < PROFILE_FRAMES; i++) {
+		profiler->frame_ms[i] = 0;
+	}
+
+	SDL_AtomicSet(&profiler->next_event, 0);
+	profiler->origin = profiler->frame_start = SDL_GetPerformanceCounter();
+	profiler->frame = 0;
+	profiler->show_graph = SDL_FALSE;
+}
+
+void record_zone(Profiler *profiler, const char *name, Uint64 start)
+{
+	Uint64 end = SDL_GetPerformanceCounter();
+	int sequence = SDL_AtomicAdd(&profiler->next_event, 1);
+	ProfileEvent *event = &profiler->event[(unsigned int)sequence % PROFILE_EVENTS];
+
+	// A seqlock: the slot is marked as being written before its fields, and numbered after them.
+	SDL_AtomicSet(&event->sequence, -1);
+	SDL_MemoryBarrierRelease();
+	event->name = name;
+	event->start = start;
+	event->end = end;
+	event->thread = SDL_ThreadID();
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&event->sequence, sequence);
+}
+
+// Called at the top of each frame, ends the last one.
+void profile_frame(Game *game)
+{
+	Profiler *profiler = &game->profiler;
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	record_zone(profiler, "frame", profiler->frame_start);
+	profiler->frame_ms[profiler->frame] = (now - profiler->frame_start) * 1000.0 / SDL_GetPerformanceFrequency();
+	profiler->frame = (profiler->frame + 1) % PROFILE_FRAMES;
+	profiler->frame_start = now;
+}
+
+static double microseconds(Profiler *profiler, Uint64 counter)
+{
+	return (double)(counter - profiler->origin) * 1000000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Write the zones still in the ring, skipping any slot a thread is writing to as it is read.
+static int write_trace(Game *game, const char *path)
+{
+	Profiler *profiler = &game->profiler;
+	int next = SDL_AtomicGet(&profiler->next_event);
+	int written = 0;
+	FILE *file = fopen(path, "w");
+
+	if (file == NULL) {
+		fprintf(stderr, "%s: Failed to create %s.\n", game->title, path);
+		return 1;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+
+	for (int i = SDL_max(0, next - PROFILE_EVENTS); i < next; i++) {
+		ProfileEvent *slot = &profiler->event[(unsigned int)i % PROFILE_EVENTS];
+		ProfileEvent event;
+
+		// The copy is whole only if the slot held zone i both before and after it.
+		if (SDL_AtomicGet(&slot->sequence) != i) {
+			continue;
+		}
+
+		SDL_MemoryBarrierAcquire();
+		event.name = slot->name;
+		event.start = slot->start;
+		event.end = slot->end;
+		event.thread = slot->thread;
+		SDL_MemoryBarrierAcquire();
+
+		if (SDL_AtomicGet(&slot->sequence) != i) {
+			continue;
+		}
+
+		fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}", written > 0 ? ",\n" : "", event.name, (unsigned long)event.thread, microseconds(profiler, event.start), microseconds(profiler, event.end) - microseconds(profiler, event.start));
+		written++;
+	}
+
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) != 0) {
+		fprintf(stderr, "%s: Failed to write %s.\n", game->title, path);
+		return 1;
+	}
+
+	fprintf(stderr, "%s: Wrote %d zones to %s.\n", game->title, written, path);
+	return 0;
+}
+
+/*
+	Bars of frame time along the bottom left, with a line at the frame rate
+	limit. The sleep overshoots it a little on every frame, so only frames
+	half as long again, which would show as a dropped frame, are red.
+*/
+void draw_frame_graph(Game *game)
+{
+	Profiler *profiler = &game->profiler;
+	SDL_Rect fast[PROFILE_FRAMES];
+	SDL_Rect slow[PROFILE_FRAMES];
+	int fast_count = 0;
+	int slow_count = 0;
+	float budget = 1000.0f / (game->pacer.rate > 0 ? game->pacer.rate : FPS);
+	int scale = 4; // Pixels per millisecond.
+	int bottom = game->height - 10;
+	Uint8 r, g, b, a;
+
+	if (!profiler->show_graph) {
+		return;
+	}
+
+	for (int i = 0; i < PROFILE_FRAMES; i++) {
+		float ms = profiler->frame_ms[(profiler->frame + i) % PROFILE_FRAMES];
+		int height = SDL_min(ms * scale, bottom);
+		SDL_Rect *bar = ms > budget * 1.5f ? &slow[slow_count++] : &fast[fast_count++];
+		set_rect((*bar), 10 + i * 2, bottom - height, 2, height);
+	}
+
+	SDL_GetRenderDrawColor(game->renderer, &r, &g, &b, &a);
+	SDL_SetRenderDrawColor(game->renderer, 0, 255, 0, SDL_ALPHA_OPAQUE);
+	SDL_RenderFillRects(game->renderer, fast, fast_count);
+	SDL_SetRenderDrawColor(game->renderer, 255, 0, 0, SDL_ALPHA_OPAQUE);
+	SDL_RenderFillRects(game->renderer, slow, slow_count);
+	SDL_SetRenderDrawColor(game->renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+	SDL_RenderDrawLine(game->renderer, 10, bottom - budget * scale, 10 + PROFILE_FRAMES * 2, bottom - budget * scale);
+	SDL_SetRenderDrawColor(game->renderer, r, g, b, a);
+}
+
+// Returns SDL_TRUE if the key was one of the profiler's.
+SDL_bool handle_profiler_key(Game *game, SDL_Scancode key)
+{
+	switch (key) {
+		case SDL_SCANCODE_F1:
+			game->profiler.show_graph ^= SDL_TRUE;
+			return SDL_TRUE;
+		case SDL_SCANCODE_F2:
+			write_trace(game, PROFILE_TRACE_FILE);
+			return SDL_TRUE;
+		default:
+			return SDL_FALSE;
+	}
+}
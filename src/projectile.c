@@ -0,0 +1,109 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Fixed pool of projectiles. Slots are handed out from a free list, so
+	firing never allocates, and a slot with no life left is free. Live
+	slots all lie below pool->end, which is what passes over the pool
+	walk.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+void init_projectile_pool(Game *game, ProjectilePool *pool, int capacity)
+{
+	pool->capacity = capacity;
+	pool->projectile = (Projectile *)malloc(sizeof(Projectile) * capacity);
+	pool->hit = (int *)malloc(sizeof(int) * capacity);
+
+	if (pool->projectile == NULL || pool->hit == NULL) {
+		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+
+	clear_projectiles(pool);
+}
+
+void free_projectile_pool(ProjectilePool *pool)
+{
+	if (pool->capacity != 0) {
+		free(pool->projectile);
+		free(pool->hit);
+	}
+
+	pool->capacity = 0;
+}
+
+void clear_projectiles(ProjectilePool *pool)
+{
+	for (int i = 0; i < pool->capacity; i++) {
+		pool->projectile[i].life = 0;
+		pool->projectile[i].next_free = i + 1 < pool->capacity ? i + 1 : -1;
+	}
+
+	for (int i = 0; i < OWNERS; i++) {
+		pool->owned[i] = 0;
+	}
+
+	pool->first_free = pool->capacity > 0 ? 0 : -1;
+	pool->end = 0;
+}
+
+// Returns NULL when the pool is full, in which case the shot is simply not fired.
+Projectile *spawn_projectile(ProjectilePool *pool, int owner, double x, double y, double dx, double dy)
+{
+	int i = pool->first_free;
+
+	if (i < 0) {
+		return NULL;
+	}
+
+	Projectile *projectile = &pool->projectile[i];
+	pool->first_free = projectile->next_free;
+	pool->owned[owner]++;
+
+	if (i >= pool->end) {
+		pool->end = i + 1;
+	}
+
+	projectile->x = projectile->prev_x = x;
+	projectile->y = projectile->prev_y = y;
+	projectile->dx = dx;
+	projectile->dy = dy;
+	projectile->owner = owner;
+	projectile->life = PROJECTILE_LIFE;
+	return projectile;
+}
+
+void remove_projectile(ProjectilePool *pool, Projectile *projectile)
+{
+	pool->owned[projectile->owner]--;
+	projectile->life = 0;
+	projectile->next_free = pool->first_free;
+	pool->first_free = projectile - pool->projectile;
+}
+
+// Pull end back past any free slots at the top, so later passes stop sooner.
+void trim_projectiles(ProjectilePool *pool)
+{
+	while (pool->end > 0 && pool->projectile[pool->end - 1].life == 0) {
+		pool->end--;
+	}
+}
@@ -0,0 +1,252 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Records a session as its seed and the input of each tick, and plays it
+	back. The simulation only changes in update_game() and reset_game(), and
+	takes its random numbers from the seed, so the same input on the same
+	ticks gives the same game, in the window or in shipxb11-sim. Input is
+	only written when it changes, which is rarely from one tick to the next,
+	so an hour of play takes a few tens of kilobytes.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "shipxb11.h"
+
+static void write_varint(SDL_RWops *file, Uint64 value)
+{
+	do {
+		Uint8 byte = value & 0x7f;
+		value >>= 7;
+		SDL_WriteU8(file, byte | (value != 0 ? 0x80 : 0));
+	} while (value != 0);
+}
+
+static SDL_bool read_varint(SDL_RWops *file, Uint64 *value)
+{
+	*value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		Uint8 byte;
+
+		if (SDL_RWread(file, &byte, 1, 1) != 1) {
+			return SDL_FALSE;
+		}
+
+		*value |= (Uint64)(byte & 0x7f) << shift;
+
+		if ((byte & 0x80) == 0) {
+			return SDL_TRUE;
+		}
+	}
+
+	return SDL_FALSE;
+}
+
+static void write_record(Replay *replay, unsigned int input)
+{
+	write_varint(replay->file, replay->tick - replay->change_tick);
+	SDL_WriteU8(replay->file, input);
+	replay->change_tick = replay->tick;
+	replay->input = input;
+}
+
+// A file that ends early plays back as if it ended there.
+static void read_record(Game *game, Replay *replay)
+{
+	Uint64 ticks;
+	Uint8 input;
+
+	if (read_varint(replay->file, &ticks) && SDL_RWread(replay->file, &input, 1, 1) == 1) {
+		replay->change_tick += ticks;
+		replay->next_input = input;
+
+		if (!(input & REPLAY_END) || read_varint(replay->file, &replay->hash)) {
+			replay->has_hash = (input & REPLAY_END) != 0;
+			return;
+		}
+	}
+
+	fprintf(stderr, "%s: %s ends early, at tick %ld.\n", game->title, replay->path, replay->tick);
+	replay->change_tick = replay->tick;
+	replay->next_input = REPLAY_END;
+}
+
+static int open_recording(Game *game, Replay *replay, Uint64 seed)
+{
+	replay->file = SDL_RWFromFile(replay->path, "wb");
+
+	if (replay->file == NULL) {
+		fprintf(stderr, "%s: Failed to create %s. %s\n", game->title, replay->path, SDL_GetError());
+		return 1;
+	}
+
+	SDL_RWwrite(replay->file, REPLAY_MAGIC, strlen(REPLAY_MAGIC), 1);
+	write_varint(replay->file, REPLAY_VERSION);
+	write_varint(replay->file, seed);
+	write_varint(replay->file, game->alien_count);
+	seed_random(game, seed);
+	return 0;
+}
+
+static int open_playback(Game *game, Replay *replay)
+{
+	char magic[sizeof(REPLAY_MAGIC) - 1];
+	Uint64 version, seed, aliens;
+
+	replay->file = SDL_RWFromFile(replay->path, "rb");
+
+	if (replay->file == NULL) {
+		fprintf(stderr, "%s: Failed to open %s. %s\n", game->title, replay->path, SDL_GetError());
+		return 1;
+	}
+
+	if (SDL_RWread(replay->file, magic, sizeof(magic), 1) != 1 || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+		!read_varint(replay->file, &version) || version != REPLAY_VERSION || !read_varint(replay->file, &seed) ||
+		!read_varint(replay->file, &aliens) || aliens < 1 || aliens > MAX_ALIEN_POPULATION) {
+		fprintf(stderr, "%s: %s is not a recording this version can play.\n", game->title, replay->path);
+		SDL_RWclose(replay->file);
+		replay->file = NULL;
+		return 1;
+	}
+
+	seed_random(game, seed);
+	game->alien_count = aliens;
+	replay->has_hash = SDL_FALSE;
+	read_record(game, replay);
+	return 0;
+}
+
+/*
+	Seed the simulation, and start recording to or playing back from
+	game->replay.path if it is set. A recording keeps the seed it is given,
+	a playback takes the seed and alien_count of the recorded session, so
+	call this before init_sprites().
+*/
+int start_replay(Game *game, Uint64 seed)
+{
+	Replay *replay = &game->replay;
+
+	replay->tick = 0;
+	replay->change_tick = 0;
+	replay->input = NO_KEY;
+	replay->restart = SDL_FALSE;
+
+	if (replay->path == NULL) {
+		seed_random(game, seed);
+		return 0;
+	}
+
+	return replay->is_playing ? open_playback(game, replay) : open_recording(game, replay, seed);
+}
+
+/*
+	Call before each update_game(). Records game->player[0].key, or replaces it
+	with the recorded input. Returns 1, instead of playing the tick, once a
+	playback has reached the end of the recording.
+*/
+int replay_input(Game *game)
+{
+	Replay *replay = &game->replay;
+
+	if (replay->file == NULL) {
+		return 0;
+	}
+
+	if (!replay->is_playing) {
+		unsigned int input = (game->player[0].key & REPLAY_KEYS) | (replay->restart ? REPLAY_RESTART : 0);
+
+		if (input != replay->input) {
+			write_record(replay, input);
+		}
+
+		replay->restart = SDL_FALSE;
+		replay->tick++;
+		return 0;
+	}
+
+	while (replay->change_tick == replay->tick) {
+		replay->input = replay->next_input;
+
+		if (replay->input & REPLAY_END) {
+			break;
+		}
+
+		read_record(game, replay);
+	}
+
+	if (replay->input & REPLAY_RESTART) {
+		reset_game(game);
+	}
+
+	game->player[0].key = replay->input & REPLAY_KEYS;
+
+	if (replay->input & REPLAY_END) {
+		return 1;
+	}
+
+	replay->tick++;
+	return 0;
+}
+
+/*
+	Close the recording, ending it with the state of the game, or check a
+	playback ended in the state that was recorded. Returns 1 if the file
+	could not be written or the playback went its own way.
+*/
+int finish_replay(Game *game)
+{
+	Replay *replay = &game->replay;
+	Uint64 hash = hash_game_state(game);
+	int status = 0;
+
+	if (replay->file == NULL) {
+		return 0;
+	}
+
+	if (!replay->is_playing) {
+		// A restart with no tick after it still changed the state.
+		write_record(replay, REPLAY_END | (replay->restart ? REPLAY_RESTART : 0));
+		write_varint(replay->file, hash);
+
+		if (SDL_RWclose(replay->file) != 0) {
+			fprintf(stderr, "%s: Failed to write %s. %s\n", game->title, replay->path, SDL_GetError());
+			status = 1;
+		} else {
+			fprintf(stderr, "%s: Recorded %ld ticks to %s.\n", game->title, replay->tick, replay->path);
+		}
+	} else {
+		SDL_RWclose(replay->file);
+
+		if (!(replay->input & REPLAY_END)) {
+			fprintf(stderr, "%s: Stopped playing back %s at tick %ld.\n", game->title, replay->path, replay->tick);
+		} else if (!replay->has_hash) {
+			status = 1;
+		} else if (hash != replay->hash) {
+			fprintf(stderr, "%s: Played back %ld ticks of %s, but the game ended as %016llx, not %016llx.\n", game->title, replay->tick, replay->path, (unsigned long long)hash, (unsigned long long)replay->hash);
+			status = 1;
+		} else {
+			fprintf(stderr, "%s: Played back %ld ticks of %s, ending as recorded.\n", game->title, replay->tick, replay->path);
+		}
+	}
+
+	replay->file = NULL;
+	replay->is_playing = SDL_FALSE;
+	return status;
+}
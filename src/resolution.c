@@ -0,0 +1,173 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Without a GPU the renderer's time goes on filling pixels, so when frames
+	take longer than the frame rate allows, the scene is drawn at one of a
+	few smaller sizes into a target texture and scaled up to the window. The
+	atlas keeps its pages pre-scaled for each of those sizes, so sprites are
+	shrunk smoothly once rather than sampled every frame. The HUD is drawn
+	over the scaled scene at full size, so the text stays sharp.
+*/
+
+#include <stdio.h>
+#include "shipxb11.h"
+
+static double step_scale(int step)
+{
+	return resolution_scale(step) / 100.0;
+}
+
+// A target texture the size of the window, which is copied over it without blending. NULL if the renderer cannot make one.
+SDL_Texture *create_scene_target(Game *game)
+{
+	SDL_RendererInfo info;
+	Uint32 format = SDL_GetWindowPixelFormat(game->window);
+	SDL_Texture *target;
+
+	if (SDL_GetRendererInfo(game->renderer, &info) != 0 || !(info.flags & SDL_RENDERER_TARGETTEXTURE)) {
+		return NULL;
+	}
+
+	target = SDL_CreateTexture(game->renderer, format != SDL_PIXELFORMAT_UNKNOWN ? format : SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, game->width, game->height);
+
+	if (target != NULL) {
+		SDL_SetTextureBlendMode(target, SDL_BLENDMODE_NONE);
+	}
+
+	return target;
+}
+
+/*
+	Call once the renderer is made and before init_sprites(), which
+	pre-scales the pages for the steps chosen here. A renderer without
+	target textures, or a failure to make one, draws at full size only.
+*/
+void init_resolution(Game *game)
+{
+	Resolution *resolution = &game->resolution;
+	SDL_RendererInfo info;
+	int steps = 1;
+
+	resolution->step = 0;
+	resolution->frames_at_step = 0;
+	resolution->frame_time = 0.0;
+	resolution->target = NULL;
+	resolution->is_drawing_target = SDL_FALSE;
+	game->atlas.steps = 1;
+
+	// Drawing only what changes needs the scene drawn straight to the window.
+	if (game->dirty.is_enabled || SDL_GetRendererInfo(game->renderer, &info) != 0 || !(info.flags & SDL_RENDERER_TARGETTEXTURE)) {
+		return;
+	}
+
+	// A GPU keeps up at full size, so only the software renderer scales unless told otherwise.
+	int lowest = resolution->lowest_scale != 0 ? resolution->lowest_scale : (info.flags & SDL_RENDERER_SOFTWARE) ? 50 : 100;
+
+	while (steps < RESOLUTION_STEPS && resolution_scale(steps) >= lowest) {
+		steps++;
+	}
+
+	if (steps == 1) {
+		return;
+	}
+
+	resolution->target = create_scene_target(game);
+
+	if (resolution->target == NULL) {
+		fprintf(stderr, "%s: Failed to create the scene target, drawing at full size. %s\n", game->title, SDL_GetError());
+		return;
+	}
+
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+	SDL_SetTextureScaleMode(resolution->target, SDL_ScaleModeLinear);
+#endif
+	game->atlas.steps = steps;
+}
+
+// Send the scene's draws to the target, in the window's coordinates, if it is drawn below full size.
+void begin_scene(Game *game)
+{
+	Resolution *resolution = &game->resolution;
+
+	if (resolution->step == 0 || SDL_SetRenderTarget(game->renderer, resolution->target) != 0) {
+		return;
+	}
+
+	SDL_RenderSetScale(game->renderer, step_scale(resolution->step), step_scale(resolution->step));
+	resolution->is_drawing_target = SDL_TRUE;
+}
+
+// Called once the scene is drawn and before the HUD. Scales the scene up to the window if it went to the target.
+void finish_scene(Game *game)
+{
+	Resolution *resolution = &game->resolution;
+	SDL_Rect rect = { 0, 0, game->width, game->height };
+
+	if (!resolution->is_drawing_target) {
+		return;
+	}
+
+	SDL_SetRenderTarget(game->renderer, NULL);
+	scale_rect(&rect, resolution->step, &rect);
+	SDL_RenderCopy(game->renderer, resolution->target, &rect, NULL);
+	resolution->is_drawing_target = SDL_FALSE;
+}
+
+/*
+	Called after each frame is presented with the time it took to draw.
+	Steps down as soon as the average runs close to the frame's budget, and
+	back up only when the step above is expected to fit with room to spare,
+	counting its cost by area, which overestimates and so does not flicker
+	between steps. Either way it then waits to see the new step's times.
+*/
+void adapt_resolution(Game *game, Uint64 frame_ticks)
+{
+	Resolution *resolution = &game->resolution;
+	double budget = 1.0 / (game->pacer.rate > 0 ? game->pacer.rate : FPS);
+	double seconds = (double)frame_ticks / SDL_GetPerformanceFrequency();
+	int step = resolution->step;
+
+	resolution->frame_time += (seconds - resolution->frame_time) * 0.1;
+
+	if (game->atlas.steps == 1 || ++resolution->frames_at_step < RESOLUTION_HOLD) {
+		return;
+	}
+
+	if (resolution->frame_time > budget * 0.9 && step + 1 < game->atlas.steps) {
+		step++;
+	} else if (step > 0) {
+		double ratio = step_scale(step - 1) / step_scale(step);
+
+		if (resolution->frame_time * ratio * ratio < budget * 0.7) {
+			step--;
+		}
+	}
+
+	if (step != resolution->step) {
+		resolution->step = step;
+		resolution->frames_at_step = 0;
+	}
+}
+
+void free_resolution(Game *game)
+{
+	if (game->resolution.target != NULL) {
+		SDL_DestroyTexture(game->resolution.target);
+	}
+}
@@ -0,0 +1,410 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Runs the game's ticks on a thread of their own, at the tick rate
+	whatever the render thread is doing, and copies what each frame needs
+	to draw into a Scene after them. The render thread takes the newest
+	Scene without waiting, so a slow present only drops frames, not ticks.
+
+	Only the simulation thread touches the simulation's parts of Game while
+	it runs. To pause, restart or show the game over screen the render thread
+	stops it between ticks, and has Game to itself until it lets it go again.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+static void add_item(Scene *scene, Frame *frame, double x, double y, double prev_x, double prev_y, int width, int height)
+{
+	SceneItem *item = &scene->item[scene->item_count++];
+	item->frame = frame;
+	item->x = x;
+	item->y = y;
+	item->prev_x = prev_x;
+	item->prev_y = prev_y;
+	item->width = width;
+	item->height = height;
+}
+
+static void add_sprite(Scene *scene, Sprite *sprite)
+{
+	if (sprite->is_visible) {
+		add_item(scene, &sprite->frame[sprite->current_frame], sprite->x, sprite->y, sprite->prev_x, sprite->prev_y, sprite->width, sprite->height);
+	}
+}
+
+// Centre the explosion on a craft of the given size.
+static void add_explosion(Game *game, Scene *scene, double x, double y, double prev_x, double prev_y, int width, int height)
+{
+	Sprite *explosion = &game->explosion;
+	int dx = width / 2 - explosion->width / 2;
+	int dy = height / 2 - explosion->height / 2;
+	add_item(scene, &explosion->frame[explosion->current_frame], x + dx, y + dy, prev_x + dx, prev_y + dy, explosion->width, explosion->height);
+}
+
+static void add_craft_explosion(Game *game, Scene *scene, Craft *craft)
+{
+	Sprite *sprite = &craft->sprite;
+
+	if (craft->is_exploding && sprite->is_visible) {
+		add_explosion(game, scene, sprite->x, sprite->y, sprite->prev_x, sprite->prev_y, sprite->width, sprite->height);
+	}
+}
+
+static void add_aliens(Game *game, Scene *scene)
+{
+	EntityStore *aliens = &game->aliens;
+
+	for (int k = 0; k < aliens->count; k++) {
+		if (!(aliens->flags[k] & ENTITY_VISIBLE)) {
+			continue;
+		}
+
+		Sprite *sprite = &game->alien_sprite[aliens->animation[k].type];
+		add_item(scene, &sprite->frame[aliens->animation[k].current_frame], aliens->x[k], aliens->y[k], aliens->prev_x[k], aliens->prev_y[k], aliens->width[k], aliens->height[k]);
+
+		if (aliens->flags[k] & ENTITY_EXPLODING) {
+			add_explosion(game, scene, aliens->x[k], aliens->y[k], aliens->prev_x[k], aliens->prev_y[k], aliens->width[k], aliens->height[k]);
+		}
+	}
+}
+
+static void add_projectiles(Game *game, Scene *scene)
+{
+	ProjectilePool *pool = &game->projectiles;
+
+	for (int i = 0; i < pool->end; i++) {
+		Projectile *projectile = &pool->projectile[i];
+
+		if (projectile->life > 0) {
+			Sprite *sprite = projectile_sprite(game, projectile);
+			add_item(scene, &sprite->frame[sprite->current_frame], projectile->x, projectile->y, projectile->prev_x, projectile->prev_y, sprite->width, sprite->height);
+		}
+	}
+}
+
+// Copy what a frame draws into the scene, in the order it was always drawn.
+static void build_scene(Game *game, Scene *scene, Uint64 tick_time)
+{
+	Sprite *ship = &game->player[0].craft.sprite;
+
+	scene->tick_time = tick_time;
+	scene->is_game_over = game->lives == 0 && !game->replay.is_playing && !game->net.is_active;
+	scene->background_y = game->background.y;
+	scene->background_prev_y = game->background.prev_y;
+	scene->alien_type = game->alien_type;
+	scene->lives = game->lives;
+
+	for (int i = 0; i < 7; i++) {
+		scene->score_digit[i] = game->score.score_digit[i];
+		scene->high_digit[i] = game->score.high_digit[i];
+	}
+
+	scene->item_count = 0;
+	scene->ship.frame = &ship->frame[ship->current_frame];
+	scene->ship.width = ship->width;
+	scene->ship.height = ship->height;
+	add_aliens(game, scene);
+	add_sprite(scene, &game->bigblue.sprite);
+	add_sprite(scene, &game->asteroid.sprite);
+
+	for (int i = 0; i < QUARTERS; i++) {
+		add_sprite(scene, &game->quarter[i].sprite);
+	}
+
+	add_craft_explosion(game, scene, &game->bigblue);
+	add_craft_explosion(game, scene, &game->asteroid);
+	scene->players = game->players;
+
+	for (int i = 0; i < game->players; i++) {
+		scene->player_item[i] = game->player[i].craft.sprite.is_visible ? scene->item_count : -1;
+		add_sprite(scene, &game->player[i].craft.sprite);
+		add_craft_explosion(game, scene, &game->player[i].craft);
+	}
+
+	add_projectiles(game, scene);
+}
+
+// Called by whichever thread has Game at the time.
+static void publish_scene(Game *game, Uint64 tick_time)
+{
+	SimThread *sim = &game->sim;
+	build_scene(game, &sim->scene[sim->back], tick_time);
+	SDL_MemoryBarrierRelease();
+	sim->back = SDL_AtomicSet(&sim->ready, sim->back | SCENE_FRESH) & ~SCENE_FRESH;
+}
+
+// The newest scene published, or the one drawn last if there is none newer.
+Scene *latest_scene(Game *game)
+{
+	SimThread *sim = &game->sim;
+
+	if (SDL_AtomicGet(&sim->ready) & SCENE_FRESH) {
+		sim->front = SDL_AtomicSet(&sim->ready, sim->front) & ~SCENE_FRESH;
+		SDL_MemoryBarrierAcquire();
+	}
+
+	return &sim->scene[sim->front];
+}
+
+// Take the keyboard for a tick. A tap is only taken once.
+static unsigned int take_keys(SimThread *sim)
+{
+	int key;
+
+	do {
+		key = SDL_AtomicGet(&sim->key);
+	} while (!SDL_AtomicCAS(&sim->key, key, key & ~TAP_KEY));
+
+	return key;
+}
+
+void change_keys(Game *game, unsigned int clear, unsigned int set)
+{
+	SimThread *sim = &game->sim;
+	int key;
+
+	do {
+		key = SDL_AtomicGet(&sim->key);
+	} while (!SDL_AtomicCAS(&sim->key, key, (key & ~clear) | set));
+}
+
+// Wait between ticks until the render thread lets the simulation go on. Returns 1 when the game is closing.
+static int park(SimThread *sim)
+{
+	SDL_LockMutex(sim->lock);
+	sim->is_parked = SDL_TRUE;
+	SDL_CondBroadcast(sim->changed);
+
+	while (SDL_AtomicGet(&sim->stop) && !sim->is_quitting) {
+		SDL_CondWait(sim->changed, sim->lock);
+	}
+
+	sim->is_parked = SDL_FALSE;
+	int is_quitting = sim->is_quitting;
+	SDL_UnlockMutex(sim->lock);
+	return is_quitting;
+}
+
+// One tick on the keyboard or the recording. Returns 0 if a network game has to wait, -1 if it is over.
+static int run_tick(Game *game)
+{
+	Player *player = &game->player[game->net.is_active ? game->net.local : 0];
+	int status = 1;
+	player->key = take_keys(&game->sim);
+
+	// At the end of a playback the player takes over.
+	if (replay_input(game) != 0) {
+		finish_replay(game);
+		game->player[0].key = NO_KEY;
+	}
+
+	PROFILE_BEGIN(update_game);
+
+	if (!game->net.is_active) {
+		update_game(game);
+	} else {
+		status = net_tick(game);
+	}
+
+	PROFILE_END(game, update_game);
+
+	// A tap the tick did not use is kept for the next one.
+	if ((player->key & TAP_KEY) && !game->replay.is_playing) {
+		change_keys(game, NO_KEY, TAP_KEY);
+	}
+
+	return status;
+}
+
+static int run_simulation(void *data)
+{
+	Game *game = data;
+	SimThread *sim = &game->sim;
+	Uint64 tick_length = SDL_GetPerformanceFrequency() / game->tick_rate;
+	Uint64 previous_time = SDL_GetPerformanceCounter();
+	Uint64 accumulator = 0;
+
+	while (1) {
+		if (SDL_AtomicGet(&sim->stop)) {
+			if (park(sim) != 0) {
+				break;
+			}
+
+			// Time spent stopped is not made up.
+			previous_time = SDL_GetPerformanceCounter();
+			accumulator = 0;
+		}
+
+		Uint64 now = SDL_GetPerformanceCounter();
+		SDL_bool has_ticked = SDL_FALSE;
+		accumulator += now - previous_time;
+		previous_time = now;
+
+		// Run as many fixed ticks as the elapsed time calls for, but drop the backlog after a long stall.
+		for (int i = 0; accumulator >= tick_length; i++) {
+			if (i == MAX_CATCH_UP_TICKS) {
+				accumulator %= tick_length;
+				break;
+			}
+
+			int status = run_tick(game);
+
+			if (status == 0) {
+				// Waiting for the other player, try again shortly.
+				accumulator = SDL_min(accumulator, tick_length * NET_ROLLBACK);
+				break;
+			}
+
+			accumulator -= tick_length;
+			has_ticked = SDL_TRUE;
+
+			if (status < 0) {
+				SDL_AtomicSet(&sim->has_ended, 1);
+				SDL_AtomicSet(&sim->stop, 1);
+				break;
+			}
+
+			// The game over screen waits for a key, so stop here rather than play on under it.
+			if (game->lives == 0 && !game->replay.is_playing && !game->net.is_active) {
+				SDL_AtomicSet(&sim->stop, 1);
+				break;
+			}
+		}
+
+		if (has_ticked) {
+			publish_scene(game, now - accumulator);
+		}
+
+		if (!SDL_AtomicGet(&sim->stop) && accumulator < tick_length) {
+			SDL_Delay((tick_length - accumulator) * 1000 / SDL_GetPerformanceFrequency());
+		}
+	}
+
+	return 0;
+}
+
+static void init_scene(Game *game, Scene *scene)
+{
+	scene->item_capacity = 2 * game->aliens.capacity + 2 + QUARTERS + 2 + 2 * PLAYERS + game->projectiles.capacity;
+	scene->item = malloc(sizeof(SceneItem) * scene->item_capacity);
+
+	if (scene->item == NULL) {
+		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+
+	scene->item_count = 0;
+}
+
+/*
+	Start the simulation thread once the sprites are loaded. It starts
+	stopped, resume_simulation() lets it run.
+*/
+int start_simulation(Game *game)
+{
+	SimThread *sim = &game->sim;
+
+	for (int i = 0; i < SCENES; i++) {
+		init_scene(game, &sim->scene[i]);
+	}
+
+	sim->back = 0;
+	sim->front = 1;
+	SDL_AtomicSet(&sim->ready, 2);
+	SDL_AtomicSet(&sim->stop, 1);
+	SDL_AtomicSet(&sim->has_ended, 0);
+	SDL_AtomicSet(&sim->key, game->player[game->net.is_active ? game->net.local : 0].key);
+	sim->is_parked = SDL_FALSE;
+	sim->is_quitting = SDL_FALSE;
+	sim->is_running = SDL_FALSE;
+	publish_scene(game, SDL_GetPerformanceCounter());
+	sim->lock = SDL_CreateMutex();
+	sim->changed = SDL_CreateCond();
+	sim->thread = NULL;
+
+	if (sim->lock != NULL && sim->changed != NULL) {
+		sim->thread = SDL_CreateThread(run_simulation, "simulation", game);
+	}
+
+	if (sim->thread == NULL) {
+		fprintf(stderr, "%s: Failed to start the simulation thread. %s\n", game->title, SDL_GetError());
+		SDL_DestroyCond(sim->changed);
+		SDL_DestroyMutex(sim->lock);
+		return 1;
+	}
+
+	return 0;
+}
+
+// Stop the simulation between ticks and wait for it, after which Game is the caller's.
+void stop_simulation(Game *game)
+{
+	SimThread *sim = &game->sim;
+
+	if (!sim->is_running) {
+		return;
+	}
+
+	SDL_LockMutex(sim->lock);
+	SDL_AtomicSet(&sim->stop, 1);
+
+	while (!sim->is_parked) {
+		SDL_CondWait(sim->changed, sim->lock);
+	}
+
+	SDL_UnlockMutex(sim->lock);
+	sim->is_running = SDL_FALSE;
+}
+
+// Let the simulation run on from the state Game is now in.
+void resume_simulation(Game *game)
+{
+	SimThread *sim = &game->sim;
+
+	if (sim->is_running) {
+		return;
+	}
+
+	publish_scene(game, SDL_GetPerformanceCounter());
+	SDL_LockMutex(sim->lock);
+	SDL_AtomicSet(&sim->stop, 0);
+	SDL_CondBroadcast(sim->changed);
+	SDL_UnlockMutex(sim->lock);
+	sim->is_running = SDL_TRUE;
+}
+
+void end_simulation(Game *game)
+{
+	SimThread *sim = &game->sim;
+
+	SDL_LockMutex(sim->lock);
+	sim->is_quitting = SDL_TRUE;
+	SDL_AtomicSet(&sim->stop, 1);
+	SDL_CondBroadcast(sim->changed);
+	SDL_UnlockMutex(sim->lock);
+	SDL_WaitThread(sim->thread, NULL);
+	SDL_DestroyCond(sim->changed);
+	SDL_DestroyMutex(sim->lock);
+
+	for (int i = 0; i < SCENES; i++) {
+		free(sim->scene[i].item);
+	}
+}
@@ -0,0 +1,235 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Splits passes over large entity stores across threads. parallel_for()
+	cuts the range into chunks and deals them out to the workers' deques,
+	and each worker works through its own before stealing from the others,
+	so a worker held up by the OS does not hold up the tick. A chunk only
+	writes results for its own items, and the caller merges them in item
+	order afterwards, so the game is the same whatever the number of threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+static void push_task(TaskDeque *deque, Task *task)
+{
+	SDL_AtomicLock(&deque->lock);
+
+	if (deque->top == deque->bottom) {
+		deque->top = deque->bottom = 0;
+	}
+
+	deque->task[deque->bottom++ % MAX_TASK_CHUNKS] = *task;
+	SDL_AtomicUnlock(&deque->lock);
+}
+
+// The owner takes its newest task.
+static SDL_bool pop_task(TaskDeque *deque, Task *task)
+{
+	SDL_bool has_task = SDL_FALSE;
+	SDL_AtomicLock(&deque->lock);
+
+	if (deque->top < deque->bottom) {
+		*task = deque->task[--deque->bottom % MAX_TASK_CHUNKS];
+		has_task = SDL_TRUE;
+	}
+
+	SDL_AtomicUnlock(&deque->lock);
+	return has_task;
+}
+
+// Another worker takes the oldest.
+static SDL_bool steal_task(TaskDeque *deque, Task *task)
+{
+	SDL_bool has_task = SDL_FALSE;
+	SDL_AtomicLock(&deque->lock);
+
+	if (deque->top < deque->bottom) {
+		*task = deque->task[deque->top++ % MAX_TASK_CHUNKS];
+		has_task = SDL_TRUE;
+	}
+
+	SDL_AtomicUnlock(&deque->lock);
+	return has_task;
+}
+
+static SDL_bool find_task(Scheduler *scheduler, int worker, Task *task)
+{
+	if (pop_task(&scheduler->deque[worker], task)) {
+		return SDL_TRUE;
+	}
+
+	for (int i = 1; i < scheduler->worker_count; i++) {
+		if (steal_task(&scheduler->deque[(worker + i) % scheduler->worker_count], task)) {
+			return SDL_TRUE;
+		}
+	}
+
+	return SDL_FALSE;
+}
+
+static void run_task(Game *game, Task *task, int worker)
+{
+	task->run(game, task->data, task->chunk, task->start, task->end, worker);
+	SDL_AtomicAdd(&game->scheduler.pending, -1);
+}
+
+static int worker_thread(void *data)
+{
+	Game *game = data;
+	Scheduler *scheduler = &game->scheduler;
+	int worker = SDL_AtomicAdd(&scheduler->started, 1) + 1;
+	Task task;
+
+	// Sleep until there is work, then help until there is none left.
+	while (SDL_SemWait(scheduler->work_ready) == 0 && !SDL_AtomicGet(&scheduler->is_stopping)) {
+		while (find_task(scheduler, worker, &task)) {
+			run_task(game, &task, worker);
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Start enough threads for workers in all, counting the caller, or for
+	one per CPU if workers is 0. Call after init_sprites(), which sizes the
+	alien store.
+*/
+void start_workers(Game *game, int workers)
+{
+	Scheduler *scheduler = &game->scheduler;
+	int masks = (game->aliens.capacity + 63) / 64;
+
+	if (workers == 0) {
+		workers = SDL_GetCPUCount();
+	}
+
+	workers = SDL_max(1, SDL_min(workers, MAX_WORKERS));
+	scheduler->worker_count = 1;
+	SDL_AtomicSet(&scheduler->pending, 0);
+	SDL_AtomicSet(&scheduler->started, 0);
+	SDL_AtomicSet(&scheduler->is_stopping, 0);
+	scheduler->work_ready = workers > 1 ? SDL_CreateSemaphore(0) : NULL;
+
+	for (int i = 0; i < MAX_WORKERS; i++) {
+		scheduler->deque[i].lock = 0;
+		scheduler->deque[i].top = scheduler->deque[i].bottom = 0;
+	}
+
+	if (scheduler->work_ready == NULL) {
+		return;
+	}
+
+	for (int i = 1; i < workers; i++) {
+		scheduler->hit_mask[i] = malloc(sizeof(Uint64) * SDL_max(masks, 1));
+
+		if (scheduler->hit_mask[i] == NULL) {
+			fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+			exit(1);
+		}
+
+		scheduler->thread[i] = SDL_CreateThread(worker_thread, "worker", game);
+
+		if (scheduler->thread[i] == NULL) {
+			free(scheduler->hit_mask[i]);
+			break;
+		}
+
+		scheduler->worker_count++;
+	}
+}
+
+// How many chunks parallel_for() cuts count items into. Small passes are not worth waking the workers for.
+int task_chunks(Game *game, int count)
+{
+	int workers = game->scheduler.worker_count;
+
+	if (workers <= 1 || count < 2 * TASK_GRAIN) {
+		return 1;
+	}
+
+	return SDL_min(SDL_min(count / TASK_GRAIN, 4 * workers), MAX_TASK_CHUNKS);
+}
+
+// Run items 0 to count - 1 in task_chunks() chunks, and return when they are all done.
+void parallel_for(Game *game, int count, TaskFunction run, void *data)
+{
+	Scheduler *scheduler = &game->scheduler;
+	int chunks = task_chunks(game, count);
+	Task task;
+
+	if (chunks == 1) {
+		run(game, data, 0, 0, count, 0);
+		return;
+	}
+
+	SDL_AtomicSet(&scheduler->pending, chunks);
+
+	for (int c = 0; c < chunks; c++) {
+		task.run = run;
+		task.data = data;
+		task.chunk = c;
+		task.start = (Sint64)count * c / chunks;
+		task.end = (Sint64)count * (c + 1) / chunks;
+		push_task(&scheduler->deque[c % scheduler->worker_count], &task);
+	}
+
+	for (int i = 1; i < scheduler->worker_count; i++) {
+		SDL_SemPost(scheduler->work_ready);
+	}
+
+	// Work too, then wait out the chunks still running elsewhere.
+	while (SDL_AtomicGet(&scheduler->pending) > 0) {
+		if (find_task(scheduler, 0, &task)) {
+			run_task(game, &task, 0);
+		}
+	}
+}
+
+Uint64 *worker_hit_mask(Game *game, int worker)
+{
+	return worker == 0 ? game->aliens.hit_mask : game->scheduler.hit_mask[worker];
+}
+
+void stop_workers(Game *game)
+{
+	Scheduler *scheduler = &game->scheduler;
+
+	if (scheduler->work_ready == NULL) {
+		return;
+	}
+
+	SDL_AtomicSet(&scheduler->is_stopping, 1);
+
+	for (int i = 1; i < scheduler->worker_count; i++) {
+		SDL_SemPost(scheduler->work_ready);
+	}
+
+	for (int i = 1; i < scheduler->worker_count; i++) {
+		SDL_WaitThread(scheduler->thread[i], NULL);
+		free(scheduler->hit_mask[i]);
+	}
+
+	SDL_DestroySemaphore(scheduler->work_ready);
+	scheduler->work_ready = NULL;
+	scheduler->worker_count = 1;
+}
@@ -18,203 +18,13 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_video.h>
-#include <SDL2/SDL_image.h>
 #include <SDL2/SDL2_rotozoom.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
-
-#define ALIEN_POPULATION 10
-#define ALIEN_TYPE 4
-#define FPS 60
-#define GAME_TITLE "Ship XB11"
-#define HEIGHT 800
-#define LEFT_KEY 0x4
-#define LINE_Y 70
-#define MAX_SOUNDS 1
-#define NO_KEY 0
-#define PAUSE_MSG 5
-#define RIGHT_KEY 0x1
-#define WIDTH 600
-
-#define set_rect(R, X, Y, W, H) R.x = X; R.y = Y; R.w = W; R.h = H
-
-typedef struct {
-	SDL_AudioSpec audio_spec;
-	SDL_bool converted;
-	Uint8 *wave_buffer;
-	Uint32 wave_length;
-} AudioInfo;
-
-typedef struct {
-	SDL_bool playing;
-	AudioInfo audio_info[MAX_SOUNDS];
-	SDL_AudioDeviceID id;
-	SDL_AudioSpec device_spec;
-	unsigned int index;
-} Audio;
-
-typedef struct {
-	SDL_bool is_animated;
-	SDL_bool is_visible;
-	double dx;
-	double dy;
-	double x;
-	double y;
-	int current_frame;
-	int frame_count;
-	int frame_delay;
-	int next_frame_time;
-	int width;
-	int height;
-	SDL_Texture **texture;
-} Sprite;
-
-typedef struct {
-	SDL_bool is_exploding;
-	SDL_bool missile_is_launched;
-	int missile_x;
-	int missile_y;
-	unsigned int key;
-	Sprite sprite;
-} Craft;
-
-typedef struct {
-	int score_digit[7];
-	int high_digit[7];
-	int high;
-	int score;
-	int visible_high;
-	int visible_score;
-	int width[10]; // Width in pixels of each digit (used for spacing digits).
-	int height[10];
-	SDL_Texture *digit[10]; // Textures for digits 0 - 9.
-} Score;
-
-typedef struct {
-	Audio audio;
-	SDL_bool paused;
-	const char *title;
-	Craft alien[ALIEN_TYPE][ALIEN_POPULATION];
-	Craft asteroid;
-	Craft bigblue;
-	Craft player;
-	Craft ul; // Upper left of broken asteroid.
-	Craft ur;
-	Craft ll;
-	Craft lr;
-	int alien_count;
-	int alien_type;
-	int height;
-	int level;
-	int lives;
-	int qcount; // Number of visible quarter asteroid pieces.
-	int width;
-	Score score;
-	Sprite alien_sprite[ALIEN_TYPE];
-	Sprite background;
-	Sprite explosion;
-	Sprite line;
-	Sprite missile;
-	Sprite big_blue_missiles;
-	Sprite playmis;
-	SDL_Texture *game_over_message;
-	SDL_Texture *paused_message[PAUSE_MSG];
-	SDL_Texture *pause_screen;
-	SDL_Renderer *renderer;
-	SDL_Window *window;
-	TTF_Font *font;
-} Game;
-
-static void reset_game(Game *);
-
-static void init_audio(Game *game)
-{
-	SDL_AudioSpec obtained;
-	int status = 1;
-	game->audio.index = 0;
-	game->audio.playing = SDL_FALSE;
-
-	for (unsigned int i = 0; i < MAX_SOUNDS; i++) {
-		game->audio.audio_info[i].wave_buffer = NULL;
-		game->audio.audio_info[i].wave_length = 0;
-		game->audio.audio_info[i].converted = SDL_FALSE;
-	}
-
-#if SDL_PATCHLEVEL > 15
-	status = SDL_GetAudioDeviceSpec(0, 0, &game->audio.device_spec);
-#endif
-	game->audio.device_spec.callback = NULL;
-
-	if (status != 0) {
-		game->audio.device_spec.freq = 44100;
-		game->audio.device_spec.format = AUDIO_S16;
-		game->audio.device_spec.channels = 2;
-		game->audio.device_spec.samples = 4096;
-	}
-
-	game->audio.id = SDL_OpenAudioDevice(NULL, 0, &game->audio.device_spec, &obtained, SDL_AUDIO_ALLOW_ANY_CHANGE);
-
-	if (game->audio.id == 0) {
-		return;
-	}
-
-	game->audio.device_spec.freq = obtained.freq;
-	game->audio.device_spec.format = obtained.format;
-	game->audio.device_spec.channels = obtained.channels;
-	game->audio.device_spec.silence = obtained.silence;
-	game->audio.device_spec.samples = obtained.samples;
-	game->audio.device_spec.size = obtained.size;
-	game->audio.device_spec.callback = NULL;
-	return;
-}
-
-static void close_audio(Game *game)
-{
-	SDL_CloseAudioDevice(game->audio.id);
-
-	for (unsigned int i = 0; i < game->audio.index; i++) {
-		if (game->audio.audio_info[i].wave_buffer == NULL) {
-			continue;
-		}
-
-		if (game->audio.audio_info[i].converted) {
-			SDL_free(game->audio.audio_info[i].wave_buffer);
-		} else {
-			SDL_FreeWAV(game->audio.audio_info[i].wave_buffer);
-		}
-	}
-}
-
-static int load_audio(Game *game, const char *path)
-{
-	SDL_AudioCVT cvt;
-	SDL_AudioSpec *audio_spec;
-	audio_spec = SDL_LoadWAV(path, &game->audio.audio_info[game->audio.index].audio_spec, &game->audio.audio_info[game->audio.index].wave_buffer, &game->audio.audio_info[game->audio.index].wave_length);
-
-	if (audio_spec == NULL) {
-		return 1;
-	}
-
-	SDL_BuildAudioCVT(&cvt, audio_spec->format, audio_spec->channels, audio_spec->freq, game->audio.device_spec.format, game->audio.device_spec.channels, game->audio.device_spec.freq);
-
-	if (cvt.needed) {
-		cvt.len = game->audio.audio_info[game->audio.index].wave_length;
-		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
-		memcpy(cvt.buf, game->audio.audio_info[game->audio.index].wave_buffer, game->audio.audio_info[game->audio.index].wave_length);
-		SDL_ConvertAudio(&cvt);
-		SDL_FreeWAV(game->audio.audio_info[game->audio.index].wave_buffer);
-		game->audio.audio_info[game->audio.index].converted = SDL_TRUE;
-		game->audio.audio_info[game->audio.index].wave_buffer = cvt.buf;
-		game->audio.audio_info[game->audio.index].wave_length = cvt.len_cvt;
-	}
-
-	game->audio.index++;
-	SDL_PauseAudioDevice(game->audio.id, 0);
-	return 0;
-}
+#include "shipxb11.h"
 
 static int check_dimensions(Game *game)
 {
@@ -236,1362 +46,730 @@ static int check_dimensions(Game *game)
 	return 0;
 }
 
-static void init_game(Game *game)
-{
-	for (int i = 0; i < 7; i++) {
-		game->score.high_digit[i] = 0;
-	}
-
-	game->paused = SDL_TRUE;
-	game->title = GAME_TITLE;
-	game->score.visible_high = 0;
-	game->score.high = 0;
-	game->qcount = 0;
-	reset_game(game);
-}
-
-static SDL_bool has_intersection(Sprite *s1, Sprite *s2)
-{
-	return !(s2->x > (s1->x + s1->width) || (s2->x + s2->width) < s1->x || s2->y > (s1->y + s1->height) || (s2->y + s2->height) < s1->y);
-}
-
-static SDL_Surface *load_image_with_index(Game *game, char *path, unsigned int indx)
-{
-	SDL_Surface *surface = NULL;
-	size_t path_len = strlen(path) + 3;
-	char *ext = strrchr(path, '.');
-	char *filename = (char *)malloc(path_len * sizeof(char));
-
-	if (filename == NULL) {
-		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
-		exit(1);
-	}
-
-	snprintf(filename, path_len, "%.*s%02d%s", (int)(ext - path), path, indx, ext);
-	surface = IMG_Load(filename);
-
-	if (surface == NULL && indx == 0) {
-		fprintf(stderr, "%s: In function %s\n", game->title, __func__);
-		fprintf(stderr, "%s: Failed to load %s.\n", game->title, filename);
-	}
-
-	free(filename);
-	return surface;
-}
-
-static void set_sprite_width_height(Sprite *sprite)
+static void get_texture_dimensions(SDL_Texture *texture, int *width, int *height)
 {
-	int acc, height, width;
+	int acc;
 	Uint32 format;
-	SDL_QueryTexture(sprite->texture[0], &format, &acc, &width, &height);
-	sprite->width = width;
-	sprite->height = height;
-}
-
-static int load_sprite(Game *game, Sprite *sprite, char *path)
-{
-	int indx = 0;
-	SDL_Surface *surface;
-
-	while ((surface = load_image_with_index(game, path, indx)) != NULL) {
-		sprite->texture = realloc(sprite->texture, sizeof(SDL_Texture **) * (indx + 1));
-
-		if (sprite->texture == NULL) {
-			fprintf(stderr, "%s: realloc returned NULL in function %s\n", game->title, __func__);
-			exit(1);
-		}
-
-		sprite->texture[indx] = SDL_CreateTextureFromSurface(game->renderer, surface);
-		SDL_FreeSurface(surface);
-
-		if (sprite->texture[indx] == NULL) {
-			for (int i = 0; i < indx; i++) {
-				SDL_DestroyTexture(sprite->texture[i]);
-			}
-
-			return 1;
-		}
-
-		indx++;
-	}
-
-	if (indx == 0) {
-		return 1;
-	}
-
-	set_sprite_width_height(sprite);
-	sprite->frame_count = indx - 1;
-	return 0;
+	SDL_QueryTexture(texture, &format, &acc, width, height);
 }
 
-static void set_sprite_defaults(Sprite *sprite)
+static void grow_render_queue(Game *game)
 {
-	sprite->texture = NULL;
-	sprite->x = sprite->y = 0.0;
-	sprite->width = sprite->height = 0;
-	sprite->current_frame = sprite->frame_delay = sprite->next_frame_time = 0;
-	sprite->dx = sprite->dy = 0.0;
-	sprite->is_visible = SDL_FALSE;
-	sprite->is_animated = SDL_FALSE;
-}
+	RenderQueue *queue = &game->queue;
+	int capacity = queue->capacity == 0 ? 64 : queue->capacity * 2;
+	queue->command = realloc(queue->command, sizeof(DrawCommand) * capacity);
+	queue->clipped = realloc(queue->clipped, sizeof(DrawCommand) * capacity);
+	queue->vertex = realloc(queue->vertex, sizeof(SDL_Vertex) * 4 * capacity);
+	queue->index = realloc(queue->index, sizeof(int) * 6 * capacity);
 
-static void copy_sprite(Game *game, Sprite *copy, Sprite *sprite)
-{
-	int i = sprite->frame_count + 1;
-	set_sprite_defaults(copy);
-	copy->width = sprite->width;
-	copy->height = sprite->height;
-	copy->frame_count = sprite->frame_count;
-	copy->texture = (SDL_Texture **)malloc(sizeof(SDL_Texture *) * i);
-
-	if (copy->texture == NULL) {
-		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+	if (queue->command == NULL || queue->clipped == NULL || queue->vertex == NULL || queue->index == NULL) {
+		fprintf(stderr, "%s: realloc returned NULL in function %s\n", game->title, __func__);
 		exit(1);
 	}
 
-	do {
-		i--;
-		copy->texture[i] = sprite->texture[i];
-	} while (i > 0);
+	queue->capacity = capacity;
 }
 
-static void draw_sprite(Game *game, Sprite *sprite)
+// Add a textured quad to the queue. A NULL srect means the whole texture.
+static void queue_texture(Game *game, SDL_Texture *texture, const SDL_Rect *srect, const SDL_Rect *drect, int layer)
 {
-	if (!sprite->is_visible) {
-		return ;
-	}
-
-	SDL_Rect drect = { (int)sprite->x, (int)sprite->y, sprite->width, sprite->height };
-	SDL_RenderCopy(game->renderer, sprite->texture[sprite->current_frame], NULL, &drect);
-
-	if (!sprite->is_animated) {
-		return;
-	}
+	RenderQueue *queue = &game->queue;
 
-	if (sprite->next_frame_time != 0) {
-		sprite->next_frame_time--;
-		return;
+	if (queue->count == queue->capacity) {
+		grow_render_queue(game);
 	}
 
-	sprite->next_frame_time = sprite->frame_delay;
+	DrawCommand *command = &queue->command[queue->count];
+	command->texture = texture;
+	command->drect = *drect;
+	SDL_GetTextureColorMod(texture, &command->colour.r, &command->colour.g, &command->colour.b);
+	SDL_GetTextureAlphaMod(texture, &command->colour.a);
+	command->layer = layer;
+	command->sequence = queue->count;
 
-	if (sprite->current_frame < sprite->frame_count) {
-		sprite->current_frame++;
+	if (srect != NULL) {
+		command->srect = *srect;
 	} else {
-		sprite->current_frame = 0;
-	}
-}
-
-static int initialise_sprite(Game *game, Sprite *sprite, char *image_path)
-{
-	set_sprite_defaults(sprite);
-	return load_sprite(game, sprite, image_path);
-}
-
-static void draw_background(Game *game)
-{
-	static int y;
-	SDL_Rect srect = { 0, 0, game->width, game->height - y };
-	SDL_Rect drect = { 0, y, game->width, game->height - y };
-	SDL_RenderCopy(game->renderer, game->background.texture[0], &srect, &drect);
-	set_rect(srect, 0, game->height - y, game->width, y);
-	set_rect(drect, 0, 0, game->width, y);
-	SDL_RenderCopy(game->renderer, game->background.texture[0], &srect, &drect);
-	y++;
-
-	if (y == game->height) {
-		y = 0;
-	}
-}
-
-static int init_sdl(Game *game)
-{
-	int status = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS);
-
-	if (status != 0) {
-		fprintf(stderr, "%s: In function %s ", game->title, __func__);
-		fprintf(stderr, "SDL_Init failed. %s\n", SDL_GetError());
-		return 1;
-	}
-
-	status = TTF_Init();
-	
-	if (status != 0) {
-		fprintf(stderr, "%s: In function %s ", game->title, __func__);
-		fprintf(stderr, "TTF_Init failed. %s\n", TTF_GetError());
-		SDL_Quit();
-		return 1;
+		set_rect(command->srect, 0, 0, 0, 0);
+		get_texture_dimensions(texture, &command->srect.w, &command->srect.h);
 	}
 
-	game->font = TTF_OpenFont(DATADIR"/BigBottomCartoon.ttf", 18);
-	
-	if (game->font == NULL) {
-		fprintf(stderr, "%s: In function %s ", game->title, __func__);
-		fprintf(stderr, "Failed to open font. %s\n", TTF_GetError());
-		TTF_Quit();
-		SDL_Quit();
-		return 1;
-	}
-
-	return 0;
+	queue->count++;
 }
 
-static void init_craft(Craft *craft)
+// Quads in a layer can overlap (an explosion over its alien), so they keep the order they were queued in.
+static int compare_draw_commands(const void *p1, const void *p2)
 {
-	craft->is_exploding = SDL_FALSE;
-	craft->missile_is_launched = SDL_FALSE;
-}
+	const DrawCommand *c1 = p1;
+	const DrawCommand *c2 = p2;
 
-static void reset_player(Game *game)
-{
-	game->playmis.x = game->playmis.y = 0;
-	game->playmis.is_visible = SDL_FALSE;
-	game->player.sprite.is_visible = SDL_TRUE;
-}
-
-static void kill_asteroid(Game *game)
-{
-	game->asteroid.sprite.is_visible = SDL_FALSE;
-	game->asteroid.is_exploding = SDL_FALSE;
-	game->ul.sprite.is_visible = SDL_FALSE;
-	game->ur.sprite.is_visible = SDL_FALSE;
-	game->ll.sprite.is_visible = SDL_FALSE;
-	game->lr.sprite.is_visible = SDL_FALSE;
-}
-
-static void reset_bigblue(Game *game)
-{
-	init_craft(&game->bigblue);
-	game->big_blue_missiles.is_visible = SDL_FALSE;
-	game->bigblue.sprite.is_visible = SDL_FALSE;
-	game->bigblue.sprite.x = game->width;
-	game->bigblue.sprite.y = game->height / 2;
-	game->bigblue.sprite.frame_delay = 3;
-}
-
-static int init_bigblue(Game *game)
-{
-	int status = initialise_sprite(game, &game->bigblue.sprite, DATADIR"/bigblue.png");
-
-	if (status != 0) {
-		return status;
+	if (c1->layer != c2->layer) {
+		return c1->layer - c2->layer;
 	}
 
-	reset_bigblue(game);
-	return 0;
+	return c1->sequence - c2->sequence;
 }
 
-static int init_player(Game *game)
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+static void submit_draw_commands(Game *game, DrawCommand *command, int count)
 {
-	init_craft(&game->player);
-	game->player.key = NO_KEY;
-	int status = initialise_sprite(game, &game->player.sprite, DATADIR"/player.png");
-	game->player.sprite.x = game->width / 2 - game->player.sprite.width / 2;
-	game->player.sprite.y = game->height - game->player.sprite.height - 20;
-	game->player.sprite.is_animated = SDL_TRUE;
-	game->player.sprite.frame_delay = 1;
-	game->player.sprite.is_visible = SDL_TRUE;
-	return status;
-}
-
-static int init_alien_type(Game *game, int indx, char *path)
-{
-	int status = initialise_sprite(game, &game->alien_sprite[indx], path);
-
-	if (status != 0) {
-		return status;
-	}
+	RenderQueue *queue = &game->queue;
+	int width, height;
+	get_texture_dimensions(command->texture, &width, &height);
 
-	for (int i = 0; i < game->alien_count; i++) {
-		init_craft(&game->alien[indx][i]);
-		copy_sprite(game, &game->alien[indx][i].sprite, &game->alien_sprite[indx]);
-		game->alien[indx][i].sprite.is_animated = SDL_TRUE;
-	}
+	for (int i = 0; i < count; i++) {
+		SDL_Vertex *v = &queue->vertex[i * 4];
+		int *index = &queue->index[i * 6];
+		float x1 = command[i].drect.x;
+		float y1 = command[i].drect.y;
+		float x2 = x1 + command[i].drect.w;
+		float y2 = y1 + command[i].drect.h;
+		float u1 = (float)command[i].srect.x / width;
+		float v1 = (float)command[i].srect.y / height;
+		float u2 = (float)(command[i].srect.x + command[i].srect.w) / width;
+		float v2 = (float)(command[i].srect.y + command[i].srect.h) / height;
+		v[0].position.x = x1; v[0].position.y = y1; v[0].tex_coord.x = u1; v[0].tex_coord.y = v1;
+		v[1].position.x = x2; v[1].position.y = y1; v[1].tex_coord.x = u2; v[1].tex_coord.y = v1;
+		v[2].position.x = x2; v[2].position.y = y2; v[2].tex_coord.x = u2; v[2].tex_coord.y = v2;
+		v[3].position.x = x1; v[3].position.y = y2; v[3].tex_coord.x = u1; v[3].tex_coord.y = v2;
 
-	return 0;
-}
-
-static void reset_aliens(Game *game)
-{
-	int leader_x = 5;
-	int leader_y = 20;
-
-	for (int i = 0; i < game->alien_type; i++) {
-		for (int j = 0; j < game->alien_count; j++) {
-			game->alien[i][j].missile_is_launched = SDL_FALSE;
-			game->alien[i][j].sprite.is_visible = SDL_TRUE;
-			game->alien[i][j].is_exploding = SDL_FALSE;
-			game->alien[i][j].sprite.dx = ((i & 1) << 2) - 2;
-			game->alien[i][j].sprite.dy = 0.1;
-			game->alien[i][j].sprite.x = leader_x + j * (game->alien[i][j].sprite.width + 20.0);
-			game->alien[i][j].sprite.y = leader_y + (i + 1) * (game->alien[i][j].sprite.height + 20.0);
+		for (int j = 0; j < 4; j++) {
+			v[j].color = command[i].colour;
 		}
-	}
-}
-
-static int init_aliens(Game *game)
-{
-	int count = 0;
-	int status = init_alien_type(game, count++, DATADIR"/purple.png");
-
-	if (status == 0) {
-		status = init_alien_type(game, count++, DATADIR"/green.png");
-	}
-
-	if (status == 0) {
-		status = init_alien_type(game, count++, DATADIR"/yellow.png");
-	}
 
-	if (status == 0) {
-		status = init_alien_type(game, count, DATADIR"/cyan.png");
+		index[0] = i * 4;
+		index[1] = i * 4 + 1;
+		index[2] = i * 4 + 2;
+		index[3] = i * 4;
+		index[4] = i * 4 + 2;
+		index[5] = i * 4 + 3;
 	}
 
-	reset_aliens(game);
-	return status;
+	SDL_RenderGeometry(game->renderer, command->texture, queue->vertex, count * 4, queue->index, count * 6);
+	queue->draw_calls++;
 }
-
-static int init_explosion(Game *game)
+#else
+static void submit_draw_commands(Game *game, DrawCommand *command, int count)
 {
-	int status = initialise_sprite(game, &game->explosion, DATADIR"/explosion.png");
-	game->explosion.is_animated = SDL_TRUE;
-	return status;
-}
-
-static int init_missile(Game *game)
-{
-	int status = initialise_sprite(game, &game->missile, DATADIR"/missile.png");
-	game->missile.x = game->missile.y = 0;
-	game->missile.frame_delay = 3;
-	game->missile.is_animated = SDL_TRUE;
-	game->missile.is_visible = SDL_TRUE;
-	return status;
-}
-
-static int init_playmis(Game *game)
-{
-	int status = initialise_sprite(game, &game->playmis, DATADIR"/playmis.png");
-	game->playmis.x = game->playmis.y = 0;
-	game->playmis.is_visible = SDL_FALSE;
-	game->playmis.frame_delay = 3;
-	game->playmis.is_animated = SDL_TRUE;
-	return status;
-}
-
-static void reset_asteroid(Game *game)
-{
-	int x[2] = { game->width, -game->asteroid.sprite.width };
-	int rand_zero_one = rand() & 1;
-	init_craft(&game->asteroid);
-	game->asteroid.sprite.x = x[rand_zero_one];
-	game->asteroid.sprite.y = LINE_Y + (rand() & 128);
-	game->asteroid.sprite.dx = (rand_zero_one << 1) - 1;
-	game->asteroid.sprite.dy = 1;
-	game->asteroid.sprite.is_visible = SDL_TRUE;
-}
+	for (int i = 0; i < count; i++) {
+		SDL_RenderCopy(game->renderer, command[i].texture, &command[i].srect, &command[i].drect);
+	}
 
-static int init_line(Game *game)
-{
-	int status = initialise_sprite(game, &game->line, DATADIR"/line.png");
-	game->line.x = 50;
-	game->line.y = LINE_Y;
-	game->line.is_visible = SDL_TRUE;
-	return status;
+	game->queue.draw_calls += count;
 }
+#endif
 
-static void reset_asteroid_quarters(Game *game)
+static SDL_bool is_same_colour(SDL_Color c1, SDL_Color c2)
 {
-	int x = game->asteroid.sprite.x;
-	int y = game->asteroid.sprite.y;
-	init_craft(&game->ul);
-	init_craft(&game->ur);
-	init_craft(&game->ll);
-	init_craft(&game->lr);
-	game->ul.sprite.x = x;
-	game->ul.sprite.y = y;
-	game->ur.sprite.x = x + game->asteroid.sprite.width / 2;
-	game->ur.sprite.y = y;
-	game->ll.sprite.x = x;
-	game->ll.sprite.y = y + game->asteroid.sprite.height / 2;
-	game->lr.sprite.x = x + game->asteroid.sprite.width / 2;
-	game->lr.sprite.y = y + game->asteroid.sprite.height / 2;
-	game->ul.sprite.dx = -0.25;
-	game->ul.sprite.dy = -1;
-	game->ur.sprite.dx = 0.25;
-	game->ur.sprite.dy = -1;
-	game->ll.sprite.dx = -0.25;
-	game->ll.sprite.dy = 1;
-	game->lr.sprite.dx = 0.25;
-	game->lr.sprite.dy = 1;
-	game->ul.sprite.is_visible = SDL_TRUE;
-	game->ur.sprite.is_visible = SDL_TRUE;
-	game->ll.sprite.is_visible = SDL_TRUE;
-	game->lr.sprite.is_visible = SDL_TRUE;
-	game->qcount = 4;
+	return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b && c1.a == c2.a;
 }
 
-static int init_asteroid_quarters(Game *game)
+// One submission per run of consecutive commands sharing a texture and colour.
+static void submit_draw_runs(Game *game, DrawCommand *command, int count)
 {
-	int status = initialise_sprite(game, &game->ul.sprite, DATADIR"/ul.png");
-
-	if (status == 0) {
-		status = initialise_sprite(game, &game->ur.sprite, DATADIR"/ur.png");
-		game->ul.sprite.is_animated = SDL_TRUE;
-	}
-
-	if (status == 0) {
-		status = initialise_sprite(game, &game->ll.sprite, DATADIR"/ll.png");
-		game->ur.sprite.is_animated = SDL_TRUE;
-	}
+	int start = 0;
 
-	if (status == 0) {
-		status = initialise_sprite(game, &game->lr.sprite, DATADIR"/lr.png");
-		game->ll.sprite.is_animated = SDL_TRUE;
+	for (int i = 1; i <= count; i++) {
+		if (i == count || command[i].texture != command[start].texture || !is_same_colour(command[i].colour, command[start].colour)) {
+			submit_draw_commands(game, &command[start], i - start);
+			start = i;
+		}
 	}
-
-	game->lr.sprite.is_animated = SDL_TRUE;
-	return status;
 }
 
-static int init_sprites(Game *game)
+// Draw each dirty rectangle, clipped to it, from the stars and the commands that touch it.
+static void submit_dirty_rects(Game *game)
 {
-	int status = init_bigblue(game);
-
-	if (status == 0) {
-		status = init_player(game);
-	}
+	RenderQueue *queue = &game->queue;
+	find_dirty_rects(game, queue->command, queue->count);
 
-	if (status == 0) {
-		status = init_aliens(game);
-	}
-
-	if (status == 0) {
-		status = initialise_sprite(game, &game->background, DATADIR"/background.jpg");
-	}
-
-	if (status == 0) {
-		status = init_explosion(game);
-	}
-
-	if (status == 0) {
-		status = init_missile(game);
-	}
-
-	if (status == 0) {
-		status = init_playmis(game);
-	}
+	for (int i = 0; i < game->dirty.count; i++) {
+		SDL_Rect *rect = &game->dirty.rect[i];
+		int count = 0;
+		SDL_RenderSetClipRect(game->renderer, rect);
 
-	if (status == 0)
-		status = init_line(game);
-
-	if (status == 0) {
-		status = initialise_sprite(game, &game->big_blue_missiles, DATADIR"/missiles.png");
-	}
-
-	if (status == 0) {
-		status = initialise_sprite(game, &game->asteroid.sprite, DATADIR"/asteroid.png");
-	}
-
-	if (status == 0) {
-		status = init_asteroid_quarters(game);
-	}
-
-	return status;
-}
-
-static void stop_animation(Sprite *sprite)
-{
-	sprite->is_animated = SDL_FALSE;
-	sprite->current_frame = 0;
-	sprite->next_frame_time = 0;
-}
-
-static void explode(Game *game, Craft *craft)
-{
-	game->explosion.is_visible = SDL_TRUE;
-	game->explosion.x = craft->sprite.x + craft->sprite.width / 2 - game->explosion.width / 2;
-	game->explosion.y = craft->sprite.y + craft->sprite.height / 2 - game->explosion.height / 2;
-
-	if (craft->sprite.is_visible) {
-		draw_sprite(game, &game->explosion);
-
-		if (game->explosion.current_frame == game->explosion.frame_count) {
-			game->explosion.current_frame = 0;
-			craft->is_exploding = SDL_FALSE;
+		if (game->starfield.is_enabled) {
+			draw_starfield(game);
+		}
 
-			if (craft == &game->player && game->lives > 0) {
-				game->lives--;
-			} else {
-				craft->sprite.is_visible = SDL_FALSE;				 
+		for (int k = 0; k < queue->count; k++) {
+			if (SDL_HasIntersection(&queue->command[k].drect, rect)) {
+				queue->clipped[count++] = queue->command[k];
 			}
-
-			game->audio.playing = SDL_FALSE;
-			return;
 		}
-	}
 
-	if (game->audio.playing == SDL_FALSE) {
-		game->audio.playing = SDL_TRUE;
-		SDL_ClearQueuedAudio(game->audio.id);
-		SDL_QueueAudio(game->audio.id, game->audio.audio_info[0].wave_buffer, game->audio.audio_info[0].wave_length);
+		submit_draw_runs(game, queue->clipped, count);
 	}
-}
-
-static void launch_missile(Game *game)
-{
-	int launcher_x[4] = { 3, 9, 22, 28 };
-	static unsigned int i;
 
-	if (!game->playmis.is_visible) {
-		game->playmis.is_visible = SDL_TRUE;
-		game->playmis.x = game->player.sprite.x + launcher_x[i & 3];
-		game->playmis.y = game->player.sprite.y;
-		i++;
-	}
+	SDL_RenderSetClipRect(game->renderer, NULL);
 }
 
-static void create_pause_screen(Game *game)
+// Draw everything queued this frame, the scene first, then the HUD over it at full size.
+static void flush_render_queue(Game *game)
 {
-	if (!game->paused) {
-		return;
-	}
+	RenderQueue *queue = &game->queue;
+	int hud = 0;
+	queue->draw_calls = 0;
+	qsort(queue->command, queue->count, sizeof(DrawCommand), compare_draw_commands);
 
-	SDL_Surface *capture;
-	Uint32 format = SDL_GetWindowPixelFormat(game->window);
-
-	if (format != SDL_PIXELFORMAT_UNKNOWN) {
-		capture = SDL_CreateRGBSurfaceWithFormat(0, game->width, game->height, SDL_BITSPERPIXEL(format), format);
-	} else {
-		fprintf(stderr, "%s: %s\n", game->title, SDL_GetError());
-		format = SDL_PIXELFORMAT_ARGB8888;
-		capture = SDL_CreateRGBSurface(0, game->width, game->height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
-	}
-
-	if (capture == NULL) {
-		fprintf(stderr, "%s: %s\n", game->title, SDL_GetError());
+	if (game->dirty.is_enabled) {
+		submit_dirty_rects(game);
+		queue->count = 0;
 		return;
 	}
 
-	if (game->pause_screen != NULL) {
-		SDL_DestroyTexture(game->pause_screen);
+	while (hud < queue->count && queue->command[hud].layer < LAYER_HUD) {
+		hud++;
 	}
 
-	SDL_RenderReadPixels(game->renderer, NULL, format, capture->pixels, capture->pitch);
-	game->pause_screen = SDL_CreateTextureFromSurface(game->renderer, capture);
-	SDL_FreeSurface(capture);
-}
-
-static void restart_after_game_over(Game *game)
-{
-	reset_game(game);
-	game->paused = SDL_FALSE;
-}
-
-static int handle_key_down(Game *game, SDL_Event *event)
-{
-	// Key pressed when game first started.
-	if (game->pause_screen == NULL && game->paused) {
-		game->paused = SDL_FALSE;
-		return 1;
-	}
-
-	if (game->paused && event->key.keysym.scancode != SDL_SCANCODE_P && event->key.keysym.scancode != SDL_SCANCODE_Q && event->key.keysym.scancode != SDL_SCANCODE_N) {
-		return 1;
+	if (game->starfield.is_enabled) {
+		draw_starfield(game);
 	}
 
-	switch (event->key.keysym.scancode) {
-		case SDL_SCANCODE_LEFT:
-			game->player.key = LEFT_KEY;
-			break;
-		case SDL_SCANCODE_RIGHT:
-			game->player.key = RIGHT_KEY;
-			break;
-		case SDL_SCANCODE_SPACE:
-		case SDL_SCANCODE_UP:
-			launch_missile(game);
-			break;
-		case SDL_SCANCODE_N:
-			restart_after_game_over(game);
-			break;
-		case SDL_SCANCODE_P:
-			if (game->lives != 0) {
-				game->paused ^= SDL_TRUE;
-				create_pause_screen(game);
-			}
-			break;
-		case SDL_SCANCODE_Q:
-			return 0;
-		default:
-			break;
-	}
-
-	return 1;
-}
-
-static int handle_key_up(Game *game, SDL_Event *event)
-{
-	switch (event->key.keysym.scancode) {
-		case SDL_SCANCODE_LEFT:
-			game->player.key &= ~LEFT_KEY;
-			break;
-		case SDL_SCANCODE_RIGHT:
-			game->player.key &= ~RIGHT_KEY;
-			break;
-		default:
-			break;
-	}
-
-	return 0;
-}
-
-static int handle_event(Game *game, SDL_Event *event)
-{
-	switch(event->type) {
-		case SDL_QUIT:
-			return 0;
-		case SDL_KEYDOWN:
-			return handle_key_down(game, event);
-		case SDL_KEYUP:
-			handle_key_up(game, event);
-			break;
-		default:
-			return 1;
-	}
-
-	return 1;
-}
-
-static void get_texture_dimensions(SDL_Texture *texture, int *width, int *height)
-{
-	int acc;
-	Uint32 format;
-	SDL_QueryTexture(texture, &format, &acc, width, height);
-}
-
-static SDL_Texture *create_text_texture(Game *game, char *text)
-{
-	SDL_Color colour = { 255, 255, 0, 128 };
-	SDL_Surface *surface = TTF_RenderText_Solid(game->font, text, colour);
-
-	if (surface == NULL) {
-		return NULL;
-	}
-
-	SDL_Texture *texture = SDL_CreateTextureFromSurface(game->renderer, surface);
-	SDL_FreeSurface(surface);
-	return texture;
+	submit_draw_runs(game, queue->command, hud);
+	finish_scene(game);
+	submit_draw_runs(game, &queue->command[hud], queue->count - hud);
+	queue->count = 0;
 }
 
-static int create_text_textures(Game *game)
+static void present_frame(Game *game)
 {
-	char string[] = { '\0', '\0' };
-
-	for (int i = 0; i < 10; i++) {
-		string[0] = i + '0';
-		game->score.digit[i] = create_text_texture(game, string);
-
-		if (game->score.digit[i] != NULL) {
-			continue;
-		}
-
-		for (int j = 0; j < i; j++) {
-			SDL_DestroyTexture(game->score.digit[j]);
-		}
-
-		return 1;
-	}
-
-	return 0;
-}
-
-static void draw_lives(Game *game)
-{
-	int sx = game->player.sprite.x;
-	int sy = game->player.sprite.y;
-	game->player.sprite.x = game->width / 2 - ((game->player.sprite.width + 2) * game->lives) / 2;
-	game->player.sprite.y = 10;
-	int inc = game->player.sprite.width + 2;
-
-	for (int i = 0; i < game->lives; i++) {
-		draw_sprite(game, &game->player.sprite);
-		game->player.sprite.x += inc;
+	if (game->dirty.is_enabled) {
+		present_dirty_rects(game);
+	} else {
+		SDL_RenderPresent(game->renderer);
 	}
-
-	game->player.sprite.x = sx;
-	game->player.sprite.y = sy;
 }
 
-static void draw_score_digits(Game *game)
+static void free_render_queue(Game *game)
 {
-	SDL_Rect drect;
-	int span = 0;
-
-	for (int i = 0; i < 7; i++) {
-		set_rect(drect, 5 + span, 1, game->score.width[game->score.score_digit[i]], game->score.height[game->score.score_digit[i]]);
-		SDL_RenderCopy(game->renderer, game->score.digit[game->score.score_digit[i]], NULL, &drect);
-		span += game->score.width[game->score.score_digit[i]];
-	}
+	free(game->queue.command);
+	free(game->queue.clipped);
+	free(game->queue.vertex);
+	free(game->queue.index);
 }
 
-static void draw_high_score_digits(Game *game)
+// Queue a quad per glyph from the glyph atlas, with x the first pen position and y the top of the line.
+static void draw_text(Game *game, const char *string, int x, int y, int layer)
 {
+	GlyphAtlas *text = &game->text;
 	SDL_Rect drect;
-	int span = 0;
-
-	for (int i = 0; i < 7; i++) {
-		set_rect(drect, WIDTH - 120 + span, 1, game->score.width[game->score.high_digit[i]], game->score.height[game->score.high_digit[i]]);
-		SDL_RenderCopy(game->renderer, game->score.digit[game->score.high_digit[i]], NULL, &drect);
-		span += game->score.width[game->score.high_digit[i]];
-	}
-}
-
-static void draw_scores(Game *game)
-{
-	int i = 6;
-
-	if (game->score.visible_score < game->score.score) {
-		while (i >= 0) {
-			game->score.score_digit[i]++;
-
-			if (game->score.score_digit[i] > 9) {
-				game->score.score_digit[i] = 0;
-				i--;
-			} else {
-				break;
-			}
-		}
-
-		game->score.visible_score++;
-	}
 
-	if (game->score.visible_high < game->score.high) {
-		i = 6;
+	for (int i = 0; string[i] != '\0'; i++) {
+		Glyph *glyph = find_glyph(text, string[i]);
 
-		while (i >= 0) {
-			game->score.high_digit[i]++;
-
-			if (game->score.high_digit[i] > 9) {
-				game->score.high_digit[i] = 0;
-				i--;
-			} else
-				break;
+		if (i > 0) {
+			x += glyph_kerning(text, string[i - 1], string[i]);
 		}
 
-		game->score.visible_high++;
-	}
-
-	draw_score_digits(game);
-	draw_high_score_digits(game);
-
-	if (game->score.score > game->score.high) {
-		game->score.high = game->score.score;
-	}
-}
-
-static void draw_aliens(Game *game)
-{
-	for (int i = 0; i < game->alien_type; i++) {
-		for (int j = 0; j < game->alien_count; j++) {
-			draw_sprite(game, &game->alien[i][j].sprite);
-
-			if (game->alien[i][j].is_exploding) {
-				explode(game, &game->alien[i][j]);
-			}
-
-			if (game->alien[i][j].missile_is_launched) {
-				game->missile.x = game->alien[i][j].missile_x;
-				game->missile.y = game->alien[i][j].missile_y;
-				draw_sprite(game, &game->missile);
-			}
-		}
+		set_rect(drect, x + glyph->offset, y, glyph->rect.w, glyph->rect.h);
+		queue_texture(game, text->texture, &glyph->rect, &drect, layer);
+		x += glyph->advance;
 	}
 }
 
-static void draw_asteroid_quarters(Game *game)
-{
-	draw_sprite(game, &game->ul.sprite);
-	draw_sprite(game, &game->ur.sprite);
-	draw_sprite(game, &game->ll.sprite);
-	draw_sprite(game, &game->lr.sprite);
-}
-
-static int render_graphics(Game *game)
+// The scene takes the frame from the pages for its resolution step, the HUD is always at full size.
+static void draw_frame(Game *game, Frame *frame, double x, double y, int width, int height, int layer)
 {
-	draw_aliens(game);
-	draw_sprite(game, &game->bigblue.sprite);
-	draw_sprite(game, &game->asteroid.sprite);
-	draw_asteroid_quarters(game);
-
-	if (game->bigblue.is_exploding) {
-		explode(game, &game->bigblue);
-	}
-
-	if (game->asteroid.is_exploding) {
-		explode(game, &game->asteroid);
-	}
-
-	draw_sprite(game, &game->player.sprite);
-
-	if (game->player.is_exploding) {
-		explode(game, &game->player);
-	}
-
-	draw_sprite(game, &game->playmis);
-	draw_sprite(game, &game->big_blue_missiles);
-	draw_lives(game);
-	draw_scores(game);
-	draw_sprite(game, &game->line);
-	return 0;
+	int step = layer == LAYER_HUD ? 0 : game->resolution.step;
+	SDL_Rect drect = { (int)x, (int)y, width, height };
+	SDL_Rect srect;
+	scale_rect(&frame->rect, step, &srect);
+	queue_texture(game, game->atlas.page[step][frame->page], &srect, &drect, layer);
 }
 
-static void move_big_blue_missiles(Game *game)
+// Queue the sprite's current frame at the given position without moving or animating the sprite.
+static void draw_sprite_at(Game *game, Sprite *sprite, double x, double y, int layer)
 {
-	if (game->big_blue_missiles.is_visible) {
-		game->big_blue_missiles.y += 2;
-
-		if (game->big_blue_missiles.y > game->height) {
-			game->big_blue_missiles.y = 0;
-			game->big_blue_missiles.is_visible = SDL_FALSE;
-			return;
-		}
-
-		if (has_intersection(&game->big_blue_missiles, &game->player.sprite)) {
-			game->big_blue_missiles.y = 0;
-			game->big_blue_missiles.is_visible = SDL_FALSE;
-			game->player.is_exploding = SDL_TRUE;
-		}
-
-		return;
-	}
-
-	if ((rand() & 1023) < game->level && game->bigblue.sprite.is_visible) {
-		game->big_blue_missiles.x = game->bigblue.sprite.x;
-		game->big_blue_missiles.y = game->bigblue.sprite.y + 101;
-		game->big_blue_missiles.is_visible = SDL_TRUE;
-	}
+	draw_frame(game, &sprite->frame[sprite->current_frame], x, y, sprite->width, sprite->height, layer);
 }
 
-static void move_bigblue(Game *game)
+// Position between the previous and current tick. Big jumps (wrapping, respawning) are not smoothed.
+static double interpolate(Game *game, double previous, double current)
 {
-	static int hit_time, dx = -2;
-
-	if (game->bigblue.sprite.is_animated) {
-		hit_time++;
-
-		if (hit_time == 500) {
-			stop_animation(&game->bigblue.sprite);
-			hit_time = 0;
-		}
-	} else {
-		hit_time = 0;
+	if (fabs(current - previous) > SNAP_DISTANCE) {
+		return current;
 	}
 
-	game->bigblue.sprite.x += dx;
-
-	if (game->bigblue.sprite.x < -game->bigblue.sprite.width) {
-		game->bigblue.sprite.x = game->width;
-	}
+	return previous + (current - previous) * game->alpha;
 }
 
-static void level_up(Game *game)
+static void draw_item(Game *game, SceneItem *item)
 {
-	game->level++;
-
-	if (game->alien_type < ALIEN_TYPE) {
-		game->alien_type++;
-	}
-
-	if (game->lives < 6) {
-		game->lives++;
-	}
-
-	reset_aliens(game);
+	draw_frame(game, item->frame, interpolate(game, item->prev_x, item->x), interpolate(game, item->prev_y, item->y), item->width, item->height, LAYER_SPRITES);
 }
 
-static void move_alien_missile(Game *game, Craft *alien)
+// The stars are drawn as the queue is flushed. Drawing only what changes holds the background still.
+static void draw_background(Game *game, Scene *scene)
 {
-	if (!alien->missile_is_launched) {
-		return;
-	}
-
-	alien->missile_y += 2;
-	game->missile.x = alien->missile_x;
-	game->missile.y = alien->missile_y;
-
-	if (alien->missile_y > game->height) {
-		alien->missile_is_launched = SDL_FALSE;
-	}
-}
+	double scroll = game->dirty.is_enabled ? 0.0 : interpolate(game, scene->background_prev_y, scene->background_y);
 
-static void check_if_player_missile_hit_alien(Game *game, Craft *alien)
-{
-	if (!game->playmis.is_visible || !alien->sprite.is_visible) {
+	if (game->starfield.is_enabled) {
+		game->starfield.scroll = scroll;
 		return;
 	}
 
-	if (has_intersection(&alien->sprite, &game->playmis)) {
-		alien->is_exploding = SDL_TRUE;
-		game->playmis.is_visible = SDL_FALSE;
-		game->score.score += 20;
-	}
+	int y = scroll;
+	int step = game->resolution.step;
+	Frame *frame = &game->background.frame[0];
+	SDL_Texture *texture = game->atlas.page[step][frame->page];
+	SDL_Rect srect = { frame->rect.x, frame->rect.y, game->width, game->height - y };
+	SDL_Rect drect = { 0, y, game->width, game->height - y };
+	scale_rect(&srect, step, &srect);
+	queue_texture(game, texture, &srect, &drect, LAYER_BACKGROUND);
+	set_rect(srect, frame->rect.x, frame->rect.y + game->height - y, game->width, y);
+	set_rect(drect, 0, 0, game->width, y);
+	scale_rect(&srect, step, &srect);
+	queue_texture(game, texture, &srect, &drect, LAYER_BACKGROUND);
 }
 
-static void check_if_quarter_hit_alien(Game *game, Craft *quarter, Craft *alien)
+static int init_sdl(Game *game)
 {
-	if (!quarter->sprite.is_visible || alien->is_exploding) {
-		return;
-	}
+	int status = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS);
 
-	if (has_intersection(&alien->sprite, &quarter->sprite)) {
-		alien->is_exploding = SDL_TRUE;
-		game->score.score += 20;
+	if (status != 0) {
+		fprintf(stderr, "%s: In function %s ", game->title, __func__);
+		fprintf(stderr, "SDL_Init failed. %s\n", SDL_GetError());
+		return 1;
 	}
-}
 
-static void check_if_quarters_hit_alien(Game *game, Craft *alien)
-{
-	if (!alien->sprite.is_visible) {
-		return;
+	status = TTF_Init();
+	
+	if (status != 0) {
+		fprintf(stderr, "%s: In function %s ", game->title, __func__);
+		fprintf(stderr, "TTF_Init failed. %s\n", TTF_GetError());
+		SDL_Quit();
+		return 1;
 	}
 
-	check_if_quarter_hit_alien(game, &game->ul, alien);
-	check_if_quarter_hit_alien(game, &game->ur, alien);
-	check_if_quarter_hit_alien(game, &game->ll, alien);
-	check_if_quarter_hit_alien(game, &game->lr, alien);
-}
-
-static void check_if_player_missile_hit_asteroid(Game *game)
-{
-	if (!game->playmis.is_visible || !game->asteroid.sprite.is_visible) {
-		return;
+	game->font = TTF_OpenFont(DATADIR"/BigBottomCartoon.ttf", 18);
+	
+	if (game->font == NULL) {
+		fprintf(stderr, "%s: In function %s ", game->title, __func__);
+		fprintf(stderr, "Failed to open font. %s\n", TTF_GetError());
+		TTF_Quit();
+		SDL_Quit();
+		return 1;
 	}
 
-	if (has_intersection(&game->asteroid.sprite, &game->playmis)) {
-		game->playmis.is_visible = SDL_FALSE;
-		game->score.score += 20;
-		reset_asteroid_quarters(game);
-		game->asteroid.is_exploding = SDL_TRUE;
-	}
+	return 0;
 }
 
-static void check_if_alien_missile_hit_player(Game *game, Craft *alien)
+// The simulation is stopped to change the game, and play_game() lets it go on.
+static void restart_after_game_over(Game *game)
 {
-	if (!alien->missile_is_launched) {
+	stop_simulation(game);
+
+	// A playback restarts the game where the recording did.
+	if (game->replay.is_playing) {
 		return;
 	}
 
-	if (has_intersection(&game->missile, &game->player.sprite)) {
-		alien->missile_is_launched = SDL_FALSE;
-		game->player.is_exploding = SDL_TRUE;
+	// Online the restart waits for its tick, so both sides make it together.
+	if (game->net.is_active) {
+		game->net.restart = SDL_TRUE;
+		return;
 	}
+
+	reset_game(game);
+	game->replay.restart = SDL_TRUE;
+	game->paused = SDL_FALSE;
 }
 
-static void move_alien_ship(Game *game, Craft *alien)
+static int handle_key_down(Game *game, SDL_Event *event)
 {
-	alien->sprite.x += alien->sprite.dx;
-	alien->sprite.y += alien->sprite.dy;
-
-	if (alien->sprite.x > game->width - alien->sprite.width || alien->sprite.x < 0) {
-		alien->sprite.dx = -alien->sprite.dx;
+	// Key pressed when game first started.
+	if (game->paused_scene == NULL && game->paused) {
+		game->paused = SDL_FALSE;
+		return 1;
 	}
 
-	if (game->level <= ALIEN_TYPE) {
-		return;
+#ifdef SHIPXB11_PROFILE
+	if (handle_profiler_key(game, event->key.keysym.scancode)) {
+		return 1;
 	}
+#endif
 
-	if ((rand() & 8191) > 8189) {
-		alien->sprite.dy = 1.0;
+	if (game->paused && event->key.keysym.scancode != SDL_SCANCODE_P && event->key.keysym.scancode != SDL_SCANCODE_Q && event->key.keysym.scancode != SDL_SCANCODE_N) {
+		return 1;
 	}
 
-	if (alien->sprite.y > 600 || alien->sprite.y < 72) {
-		alien->sprite.dy = -alien->sprite.dy;
+	switch (event->key.keysym.scancode) {
+		case SDL_SCANCODE_LEFT:
+			change_keys(game, RIGHT_KEY, LEFT_KEY);
+			break;
+		case SDL_SCANCODE_RIGHT:
+			change_keys(game, LEFT_KEY, RIGHT_KEY);
+			break;
+		case SDL_SCANCODE_SPACE:
+		case SDL_SCANCODE_UP:
+			// A tap fires on the next tick even if the key is let go first.
+			change_keys(game, NO_KEY, FIRE_KEY | (event->key.repeat ? NO_KEY : TAP_KEY));
+			break;
+		case SDL_SCANCODE_N:
+			restart_after_game_over(game);
+			break;
+		case SDL_SCANCODE_P:
+			// The other player's game would not stop with this one.
+			if (game->net.is_active) {
+				break;
+			}
+
+			stop_simulation(game);
+
+			if (game->lives != 0) {
+				game->paused ^= SDL_TRUE;
+			}
+			break;
+		case SDL_SCANCODE_Q:
+			return 0;
+		default:
+			break;
 	}
+
+	return 1;
 }
 
-static void fire_alien_ship_missile(Game *game, Craft *alien)
+static int handle_key_up(Game *game, SDL_Event *event)
 {
-	if ((rand() & 1023) >= game->level || alien->missile_is_launched) {
-		return;
+	switch (event->key.keysym.scancode) {
+		case SDL_SCANCODE_LEFT:
+			change_keys(game, LEFT_KEY, NO_KEY);
+			break;
+		case SDL_SCANCODE_RIGHT:
+			change_keys(game, RIGHT_KEY, NO_KEY);
+			break;
+		case SDL_SCANCODE_SPACE:
+		case SDL_SCANCODE_UP:
+			change_keys(game, FIRE_KEY, NO_KEY);
+			break;
+		default:
+			break;
 	}
 
-	alien->missile_is_launched = SDL_TRUE;
-	alien->missile_x = alien->sprite.x + alien->sprite.width / 2;
-	alien->missile_y = alien->sprite.y + alien->sprite.height;
+	return 0;
 }
 
-static void move_aliens(Game *game)
+static int handle_event(Game *game, SDL_Event *event)
 {
-	int aliens_alive = 0;
-
-	for (int i = 0; i < game->alien_type; i++) {
-		for (int j = 0; j < game->alien_count; j++) {
-			move_alien_missile(game, &game->alien[i][j]);
-			check_if_alien_missile_hit_player(game, &game->alien[i][j]);
-
-			if (game->alien[i][j].sprite.is_visible) {
-				aliens_alive++;
-				check_if_player_missile_hit_alien(game, &game->alien[i][j]);
-				check_if_quarters_hit_alien(game, &game->alien[i][j]);
-				move_alien_ship(game, &game->alien[i][j]);
-				fire_alien_ship_missile(game, &game->alien[i][j]);
+	switch(event->type) {
+		case SDL_QUIT:
+			return 0;
+		case SDL_KEYDOWN:
+			return handle_key_down(game, event);
+		case SDL_KEYUP:
+			handle_key_up(game, event);
+			break;
+		case SDL_WINDOWEVENT:
+			// Only the changed tiles are updated, so a window uncovered or restored needs all of it drawn again.
+			if (event->window.event == SDL_WINDOWEVENT_EXPOSED || event->window.event == SDL_WINDOWEVENT_SHOWN || event->window.event == SDL_WINDOWEVENT_RESTORED) {
+				game->dirty.is_full = SDL_TRUE;
 			}
-		}
+			break;
+		default:
+			return 1;
 	}
 
-	if (aliens_alive == 0) {
-		level_up(game);
-	}
+	return 1;
 }
 
-static void move_player(Game *game)
+static void draw_lives(Game *game, Scene *scene)
 {
-	static int x = WIDTH / 2;
-
-	if (game->player.key == LEFT_KEY && x >= game->player.sprite.x) {
-		x -= 2;
-	} else if (game->player.key == RIGHT_KEY && x <= game->player.sprite.x) {
-		x += 2;
-	}
+	int x = game->width / 2 - ((scene->ship.width + 2) * scene->lives) / 2;
+	int inc = scene->ship.width + 2;
 
-	if (game->player.sprite.x > x) {
-		if (game->player.sprite.x > 0) {
-			game->player.sprite.x--;
-		}
-	} else if (game->player.sprite.x < x) {
-		if (game->player.sprite.x < game->width - game->player.sprite.width) {
-			game->player.sprite.x++;
-		}
+	for (int i = 0; i < scene->lives; i++) {
+		draw_frame(game, scene->ship.frame, x, 10, scene->ship.width, scene->ship.height, LAYER_HUD);
+		x += inc;
 	}
 }
 
-static void check_if_player_missile_hit_bigblue(Game *game)
+static void draw_digits(Game *game, int *digit, int x)
 {
-	if (!game->bigblue.sprite.is_visible || !has_intersection(&game->bigblue.sprite, &game->playmis)) {
-		return;
-	}
-
-	game->playmis.is_visible = SDL_FALSE;
+	char string[8];
 
-	if (game->bigblue.sprite.is_animated) {
-		stop_animation(&game->bigblue.sprite);
-		game->bigblue.is_exploding = SDL_TRUE;
-		game->score.score += 100;
-	} else {
-		game->bigblue.sprite.is_animated = SDL_TRUE;
+	for (int i = 0; i < 7; i++) {
+		string[i] = digit[i] + '0';
 	}
+
+	string[7] = '\0';
+	draw_text(game, string, x, 1, LAYER_HUD);
 }
 
-static void check_if_quarter_hit_bigblue(Game *game, Craft *quarter)
+// In a two player game each ship has its number under it.
+static void draw_player_numbers(Game *game, Scene *scene)
 {
-	if (!has_intersection(&game->bigblue.sprite, &quarter->sprite)) {
-		return;
-	}
-
-	if (game->bigblue.sprite.is_animated) {
-		stop_animation(&game->bigblue.sprite);
-		game->bigblue.is_exploding = SDL_TRUE;
-		game->score.score += 100;
-	} else {
-		game->bigblue.sprite.is_animated = SDL_TRUE;
+	for (int i = 0; i < scene->players && scene->players > 1; i++) {
+		if (scene->player_item[i] >= 0) {
+			SceneItem *item = &scene->item[scene->player_item[i]];
+			char number[] = { '1' + i, '\0' };
+			double x = interpolate(game, item->prev_x, item->x) + item->width / 2 - text_width(&game->text, number) / 2;
+			draw_text(game, number, x, item->y + item->height, LAYER_HUD);
+		}
 	}
 }
 
-static void check_if_quarters_hit_bigblue(Game *game)
+static int render_graphics(Game *game, Scene *scene)
 {
-	if (!game->bigblue.sprite.is_visible) {
-		return;
+	for (int i = 0; i < scene->item_count; i++) {
+		draw_item(game, &scene->item[i]);
 	}
 
-	check_if_quarter_hit_bigblue(game, &game->ul);
-	check_if_quarter_hit_bigblue(game, &game->ur);
-	check_if_quarter_hit_bigblue(game, &game->ll);
-	check_if_quarter_hit_bigblue(game, &game->lr);
+	draw_player_numbers(game, scene);
+	draw_lives(game, scene);
+	draw_digits(game, scene->score_digit, 5);
+	draw_digits(game, scene->high_digit, WIDTH - 120);
+	draw_sprite_at(game, &game->line, game->line.x, game->line.y, LAYER_HUD);
+	return 0;
 }
 
-static void move_player_missile(Game *game)
+static void show_game_over_message(Game *game)
 {
-	if (!game->playmis.is_visible) {
-		return;
-	}
+	const char *message = "Game Over! (Press n for new game)";
+	int width = text_width(&game->text, message);
+	draw_text(game, message, game->width / 2 - width / 2, game->height / 2 - game->text.height / 2 - 40, LAYER_HUD);
+}
 
-	game->playmis.y -= 5;
+static void show_paused_message(Game *game)
+{
+	static const char *message[PAUSE_MSG] = {
+		" - Space or cursor up.",
+		" - Cursor left / right.",
+		"P - Pause / Play",
+		"N - New Game",
+		"Q - Quit"
+	};
+	int width[PAUSE_MSG];
+	int height = game->text.height;
+	int hp = 0;
 
-	if (game->playmis.y < LINE_Y) {
-		game->playmis.is_visible = SDL_FALSE;
+	for (int i = 0; i < PAUSE_MSG; i++) {
+		width[i] = text_width(&game->text, message[i]);
+		draw_text(game, message[i], game->width / 2 - width[i] / 2, game->height / 2 - height / 2 + hp, LAYER_HUD);
+		hp += height + 10;
 	}
 
-	check_if_player_missile_hit_bigblue(game);
+	draw_sprite_at(game, &game->playmis, game->width / 2 - width[0] / 2 - 24, game->height / 2 - height / 2 + 10, LAYER_HUD);
+	draw_sprite_at(game, &game->player[0].craft.sprite, game->width / 2 - width[1] / 2 - 40, game->height / 2 - height / 2 + height + 10, LAYER_HUD);
 }
 
-static void move_asteroid(Game *game)
+/*
+	Freeze the last frame behind the pause screen by drawing its scene again,
+	at full size, into the pause screen's target, which is made once. Nothing
+	is read back from the renderer.
+*/
+static void create_pause_screen(Game *game, Scene *scene)
 {
-	if (!game->asteroid.sprite.is_visible) {
+	int step = game->resolution.step;
+	game->paused_scene = scene;
+
+	if (game->pause_screen == NULL || SDL_SetRenderTarget(game->renderer, game->pause_screen) != 0) {
 		return;
 	}
 
-	game->asteroid.sprite.x += game->asteroid.sprite.dx;
-	game->asteroid.sprite.y += game->asteroid.sprite.dy;
-	check_if_player_missile_hit_asteroid(game);
-
-	if (game->asteroid.sprite.x > game->width || game->asteroid.sprite.y > game->height || game->asteroid.sprite.x < -game->asteroid.sprite.width) {
-		game->asteroid.sprite.is_visible = SDL_FALSE;
-	}
+	game->resolution.step = 0;
+	game->dirty.is_full = SDL_TRUE;
+	draw_background(game, scene);
+	render_graphics(game, scene);
+	flush_render_queue(game);
+	SDL_SetRenderTarget(game->renderer, NULL);
+	game->resolution.step = step;
 }
 
-static void move_asteroid_quarters(Game *game)
+// Without target textures the frozen scene is drawn again each time, and is not dimmed.
+static void draw_paused_screen(Game *game)
 {
-	if (game->qcount == 0) {
-		return;
-	}
-
-	if (game->ul.sprite.is_visible) {
-		game->ul.sprite.x += game->ul.sprite.dx;
-		game->ul.sprite.y += game->ul.sprite.dy;
+	SDL_Rect srect = { 0, 0, game->width, game->height };
+	SDL_Rect drect = { 0, 0, game->width, game->height };
 
-		if (game->ul.sprite.x < -game->ul.sprite.width || game->ul.sprite.y < -game->ul.sprite.height) {
-			game->qcount--;
-			game->ul.sprite.is_visible = SDL_FALSE;
-		}
-	}
-
-	if (game->ur.sprite.is_visible) {
-		game->ur.sprite.x += game->ur.sprite.dx;
-		game->ur.sprite.y += game->ur.sprite.dy;
-
-		if (game->ur.sprite.x > game->width || game->ur.sprite.y < -game->ur.sprite.height) {
-			game->qcount--;
-			game->ur.sprite.is_visible = SDL_FALSE;
-		}
+	if (game->paused_scene != NULL && game->pause_screen != NULL) {
+		queue_texture(game, game->pause_screen, &srect, &drect, LAYER_BACKGROUND);
+	} else if (game->paused_scene != NULL) {
+		draw_background(game, game->paused_scene);
+		render_graphics(game, game->paused_scene);
+	} else if (!game->starfield.is_enabled) {
+		Frame *frame = &game->background.frame[0];
+		srect.x = frame->rect.x;
+		srect.y = frame->rect.y;
+		queue_texture(game, game->atlas.page[0][frame->page], &srect, &drect, LAYER_BACKGROUND);
 	}
 
-	if (game->ll.sprite.is_visible) {
-		game->ll.sprite.x += game->ll.sprite.dx;
-		game->ll.sprite.y += game->ll.sprite.dy;
-
-		if (game->ll.sprite.x < -game->ll.sprite.width || game->ll.sprite.y > game->height) {
-			game->qcount--;
-			game->ll.sprite.is_visible = SDL_FALSE;
-		}
+	if (game->lives == 0) {
+		show_game_over_message(game);
 	}
 
-	if (game->lr.sprite.is_visible) {
-		game->lr.sprite.x += game->lr.sprite.dx;
-		game->lr.sprite.y += game->lr.sprite.dy;
-
-		if (game->lr.sprite.x > game->width || game->lr.sprite.y > game->height) {
-			game->qcount--;
-			game->lr.sprite.is_visible = SDL_FALSE;
-		}
-	}
+	show_paused_message(game);
+	game->dirty.is_full = SDL_TRUE;
+	flush_render_queue(game);
+	present_frame(game);
+}
 
-	check_if_quarters_hit_bigblue(game);
+// Ticks until the sprite shows its next animation frame.
+static int ticks_until_next_frame(Sprite *sprite)
+{
+	return sprite->next_frame_time + 1;
 }
 
-static void move_graphics(Game *game)
+static void restore_animation(Sprite *sprite, Sprite *saved)
 {
-	move_bigblue(game);
-	move_big_blue_missiles(game);
-	move_aliens(game);
-	move_player(game);
-	move_player_missile(game);
-	move_asteroid(game);
-	move_asteroid_quarters(game);
+	sprite->current_frame = saved->current_frame;
+	sprite->next_frame_time = saved->next_frame_time;
 }
 
-static void show_game_over_message(Game *game)
+/*
+	While paused, at the title screen or after game over, block until an event
+	arrives or one of the pause screen animations is due, and only redraw then.
+	The animations are put back afterwards, so however long the game was
+	paused a recording of it plays back the same. Returns 0 if the player quit.
+*/
+static int wait_while_paused(Game *game)
 {
-	static int width, height;
+	SDL_Event event;
+	Sprite playmis = game->playmis;
+	Sprite player = game->player[0].craft.sprite;
+	int status = 1;
+	Uint32 tick_ms = 1000 / game->tick_rate;
+	int ticks = SDL_min(ticks_until_next_frame(&game->playmis), ticks_until_next_frame(&game->player[0].craft.sprite));
+	Uint32 due = SDL_GetTicks() + ticks * tick_ms;
+	draw_paused_screen(game);
 
-	if (width == 0) {
-		get_texture_dimensions(game->game_over_message, &width, &height);
-	}
+	while (game->paused) {
+		SDL_bool redraw = SDL_FALSE;
+		Sint32 timeout = (Sint32)(due - SDL_GetTicks());
 
-	SDL_Rect rect;
-	set_rect(rect, game->width / 2 - width / 2, game->height / 2 - height / 2 - 40, width, height);
-	SDL_RenderCopy(game->renderer, game->game_over_message, NULL, &rect);
-}
+		if (SDL_WaitEventTimeout(&event, timeout > 0 ? timeout : 0) != 0) {
+			if (handle_event(game, &event) == 0) {
+				status = 0;
+				break;
+			}
 
-static void do_irregular_actions(Game *game)
-{
-	// Bring on Big Blue alien at random.
-	if (!game->bigblue.sprite.is_visible) {
-		if ((rand() & 8191) > 8189) {
-			reset_bigblue(game);
-			game->bigblue.sprite.is_visible = SDL_TRUE;
+			redraw = event.type == SDL_WINDOWEVENT || event.type == SDL_KEYDOWN;
+		} else if (timeout <= 0) {
+			for (int i = 0; i < ticks; i++) {
+				animate_sprite(&game->playmis);
+				animate_sprite(&game->player[0].craft.sprite);
+			}
+
+			ticks = SDL_min(ticks_until_next_frame(&game->playmis), ticks_until_next_frame(&game->player[0].craft.sprite));
+			due += ticks * tick_ms;
+			redraw = SDL_TRUE;
 		}
-	}
 
-	// Bring on asteroid at random.
-	if (!game->asteroid.sprite.is_visible && game->qcount == 0) {
-		if ((rand() & 8191) > 8182) {
-			reset_asteroid(game);
+		if (redraw && game->paused) {
+			draw_paused_screen(game);
 		}
 	}
+
+	restore_animation(&game->playmis, &playmis);
+	restore_animation(&game->player[0].craft.sprite, &player);
+	return status;
 }
 
-static void show_paused_message(Game *game)
+static int poll_events(Game *game)
 {
-	int hp = 0;
-	static int width[PAUSE_MSG], height[PAUSE_MSG];
-	SDL_Rect rect;
+	SDL_Event event;
 
-	if (width[0] == 0) {
-		for (int i = 0; i < PAUSE_MSG; i++) {
-			get_texture_dimensions(game->paused_message[i], &width[i], &height[i]);
+	while (SDL_PollEvent(&event) != 0) {
+		if (handle_event(game, &event) == 0) {
+			return 0;
 		}
 	}
 
-	for (int i = 0; i < PAUSE_MSG; i++) {
-		set_rect(rect, game->width / 2 - width[i] / 2, game->height / 2 - height[i] / 2 + hp, width[i], height[i]);
-		SDL_RenderCopy(game->renderer, game->paused_message[i], NULL, &rect);
-		hp += height[i] + 10;
-	}
-
-	double x = game->playmis.x;
-	double y = game->playmis.y;
-	game->playmis.x = game->width / 2 - width[0] / 2 - 24;
-	game->playmis.y = game->height / 2 - height[0] / 2 + 10;
-	SDL_bool is_visible = game->playmis.is_visible;
-	game->playmis.is_visible = SDL_TRUE;
-	draw_sprite(game, &game->playmis);
-	game->playmis.is_visible = is_visible;
-	game->playmis.x = x;
-	game->playmis.y = y;
-	x = game->player.sprite.x;
-	y = game->player.sprite.y;
-	game->player.sprite.x = game->width / 2 - width[1] / 2 - 40;
-	game->player.sprite.y = game->height / 2 - height[1] / 2 + height[0] + 10;
-	draw_sprite(game, &game->player.sprite);
-	game->player.sprite.x = x;
-	game->player.sprite.y = y;
+	return 1;
 }
 
+/*
+	Draw the newest scene the simulation thread has published, as often as
+	the frame limit allows. The simulation runs whenever the game is not
+	paused, see scene.c.
+*/
 static int play_game(Game *game)
 {
-	SDL_Event event;
-	struct timespec ts;
-	ts.tv_sec = 0;
-	ts.tv_nsec = 100000;
-	Uint32 frame_delay_ticks = (Uint32)((double)SDL_GetPerformanceFrequency() / (double)FPS);
-	Uint64 start_time = SDL_GetPerformanceCounter();
+	Uint64 tick_length = SDL_GetPerformanceFrequency() / game->tick_rate;
+	Scene *drawn = NULL; // The scene of the last frame.
 
 	while (1) {
-		if (SDL_PollEvent(&event) != 0) {
-			if (handle_event(game, &event) == 0) {
-				break;
-			}
+		PROFILE_FRAME(game);
+		PROFILE_BEGIN(poll_events);
+
+		if (poll_events(game) == 0) {
+			break;
 		}
 
-		if (game->paused) {
-			SDL_Rect srect = { 0, 0, game->width, game->height };
-			SDL_Rect drect = { 0, 0, game->width, game->height };
+		PROFILE_END(game, poll_events);
 
-			if (game->pause_screen != NULL) {
-				SDL_RenderCopy(game->renderer, game->pause_screen, &srect, &drect);
-			} else {
-				SDL_RenderCopy(game->renderer, game->background.texture[0], &srect, &drect);
+		if (game->paused) {
+			if (drawn != NULL) {
+				create_pause_screen(game, drawn);
 			}
 
-			if (game->lives == 0) {
-				show_game_over_message(game); 
-			}	 
+			if (wait_while_paused(game) == 0) {
+				break;
+			}
 
-			show_paused_message(game);
-			SDL_RenderPresent(game->renderer);
-			nanosleep(&ts, NULL);
+			start_pacer(game);
+			game->dirty.is_full = SDL_TRUE;
 			continue;
 		}
 
-		if (game->lives == 0) {
+		resume_simulation(game);
+		Scene *scene = latest_scene(game);
+
+		// A playback carries on to the recorded restart, and a network game until either player restarts.
+		if (scene->is_game_over) {
+			stop_simulation(game);
 			game->paused = SDL_TRUE;
-			create_pause_screen(game);
+			continue;
 		}
 
-		draw_background(game);
-		render_graphics(game);
-		do_irregular_actions(game);
-		move_graphics(game);
-		SDL_RenderPresent(game->renderer);
-		Uint64 diff = SDL_GetPerformanceCounter() - start_time;
-
-		while (diff < frame_delay_ticks) {
-			nanosleep(&ts, NULL);
-			diff = SDL_GetPerformanceCounter() - start_time;
+		if (SDL_AtomicGet(&game->sim.has_ended)) {
+			break;
 		}
 
-		start_time = SDL_GetPerformanceCounter();
-	}
-
-	return 0;
-}
-
-static void reset_game(Game *game)
-{
-	for (int i = 0; i < 7; i++) {
-		game->score.score_digit[i] = 0;
-	}
-
-	game->alien_count = ALIEN_POPULATION;
-	game->level = 1;
-	game->lives = 3;
-	game->score.score = 0;
-	game->score.visible_score = 0;
-	game->alien_type = 1;
-	reset_aliens(game);
-	reset_bigblue(game);
-	reset_player(game);
-	kill_asteroid(game);
-}
-
-static int init_textures(Game *game)
-{
-	int acc;
-	Uint32 format;
-
-	int status = create_text_textures(game);
-
-	if (status != 0) {
-		return 1;
-	}
-
-	for (int i = 0; i < 10; i++) {
-		SDL_QueryTexture(game->score.digit[i], &format, &acc, &game->score.width[i], &game->score.height[i]);
-	}
-
-	game->game_over_message = create_text_texture(game, "Game Over! (Press n for new game)");
-
-	if (game->game_over_message == NULL) {
-		return 1;
-	}
-
-	int i = 0;
-	game->paused_message[i] = create_text_texture(game, " - Space or cursor up.");
-
-	if (game->paused_message[i] == NULL) {
-		return 1;
-	}
-
-	game->paused_message[++i] = create_text_texture(game, " - Cursor left / right.");
-
-	if (game->paused_message[i] == NULL) {
-		return 1;
-	}
-
-	game->paused_message[++i] = create_text_texture(game, "P - Pause / Play");
-
-	if (game->paused_message[i] == NULL) {
-		return 1;
-	}
+		// How far into the next tick the simulation will be by now. It stops at the latest tick if the next is late.
+		double elapsed = (double)(Sint64)(SDL_GetPerformanceCounter() - scene->tick_time);
+		game->alpha = SDL_max(0.0, SDL_min(elapsed / tick_length, 1.0));
+		PROFILE_BEGIN(update_residency);
 
-	game->paused_message[++i] = create_text_texture(game, "N - New Game");
+		// A level up in the scene may need aliens whose textures are not built yet.
+		if (update_residency(game, scene->alien_type) != 0) {
+			break;
+		}
 
-	if (game->paused_message[i] == NULL) {
-		return 1;
-	}
+		PROFILE_END(game, update_residency);
+		// Building textures is a one off, so the frame is timed from here.
+		Uint64 frame_start = SDL_GetPerformanceCounter();
+		PROFILE_BEGIN(draw_background);
+		begin_scene(game);
+		draw_background(game, scene);
+		PROFILE_END(game, draw_background);
+		PROFILE_BEGIN(render_graphics);
+		render_graphics(game, scene);
+
+		if (scene->lives == 0 && game->net.is_active) {
+			show_game_over_message(game);
+		}
 
-	game->paused_message[++i] = create_text_texture(game, "Q - Quit");
+		PROFILE_END(game, render_graphics);
+		PROFILE_BEGIN(flush_render_queue);
+		flush_render_queue(game);
+		PROFILE_END(game, flush_render_queue);
+		drawn = scene;
+		PROFILE_GRAPH(game);
+		PROFILE_BEGIN(present);
+		Uint64 frame_end = SDL_GetPerformanceCounter();
+		present_frame(game);
+		PROFILE_END(game, present);
+
+		// With vsync the present waits for the display, which is not time spent drawing.
+		if (!game->pacer.has_vsync) {
+			frame_end = SDL_GetPerformanceCounter();
+		}
 
-	if (game->paused_message[i] == NULL) {
-		return 1;
+		adapt_resolution(game, frame_end - frame_start);
+		PROFILE_BEGIN(sleep);
+		pace_frame(game);
+		PROFILE_END(game, sleep);
 	}
 
 	return 0;
@@ -1625,11 +803,13 @@ static int init(Game *game)
 		return 1;
 	}
 
-	game->renderer = SDL_CreateRenderer(game->window, -1, 0);
+	Uint32 flags = init_pacer(game);
+	game->renderer = game->dirty.is_enabled ? create_dirty_renderer(game) : SDL_CreateRenderer(game->window, -1, flags);
 
 	if (game->renderer == NULL) {
 		fprintf(stderr, "%s: In function %s ", game->title, __func__);
 		fprintf(stderr, "SDL_CreateRenderer failed. %s\n", SDL_GetError());
+		free_dirty_rects(game);
 		SDL_DestroyWindow(game->window);
 		TTF_CloseFont(game->font);
 		TTF_Quit();
@@ -1637,13 +817,28 @@ static int init(Game *game)
 		return 1;
 	}
 
+	start_pacer(game);
 	SDL_SetRenderDrawColor(game->renderer, 255, 255, 0, SDL_ALPHA_OPAQUE);
-	game->pause_screen = NULL;
-	game->game_over_message = NULL;
+	init_resolution(game);
+	init_starfield(game);
+	game->queue.capacity = game->queue.count = 0;
+	game->queue.command = NULL;
+	game->queue.clipped = NULL;
+	game->queue.vertex = NULL;
+	game->queue.index = NULL;
+	game->pause_screen = create_scene_target(game);
+	game->paused_scene = NULL;
+
+	if (game->pause_screen != NULL) {
+		SDL_SetTextureColorMod(game->pause_screen, PAUSE_DIM, PAUSE_DIM, PAUSE_DIM);
+	}
 
-	status = init_textures(game);
+	status = init_text(game);
 
 	if (status != 0) {
+		free_starfield(game);
+		free_resolution(game);
+		free_dirty_rects(game);
 		SDL_DestroyRenderer(game->renderer);
 		SDL_DestroyWindow(game->window);
 		TTF_CloseFont(game->font);
@@ -1652,77 +847,154 @@ static int init(Game *game)
 		return status;
 	}
 
-	return init_sprites(game);
+	return 0;
 }
 
-static void free_sprite(Sprite *sprite)
+static void free_graphics(Game *game)
 {
-	for (int i = 0; i < sprite->frame_count; i++) {
-		SDL_DestroyTexture(sprite->texture[i]);
-	}
+	free_sprites(game);
+	SDL_DestroyTexture(game->pause_screen);
+	free_text(game);
+	free_resolution(game);
+	free_starfield(game);
+	free_dirty_rects(game);
 
-	free(sprite->texture);
+	free_render_queue(game);
+	SDL_DestroyRenderer(game->renderer);
+	SDL_DestroyWindow(game->window);
+	TTF_Quit();
+	SDL_Quit();
 }
 
-static void free_graphics(Game *game)
+static int parse_number(Game *game, const char *option, const char *value, int min, int max, int *number)
 {
-	free_sprite(&game->background);
-	free_sprite(&game->explosion);
-	free_sprite(&game->line);
-	free_sprite(&game->missile);
-	free_sprite(&game->big_blue_missiles);
-	free_sprite(&game->playmis);
-	free_sprite(&game->asteroid.sprite);
-	free_sprite(&game->bigblue.sprite);
-	free_sprite(&game->player.sprite);
-	free_sprite(&game->ul.sprite);
-	free_sprite(&game->ur.sprite);
-	free_sprite(&game->ll.sprite);
-	free_sprite(&game->lr.sprite);
-	SDL_DestroyTexture(game->pause_screen);
-	SDL_DestroyTexture(game->game_over_message);
+	char *end;
+	long n = value == NULL ? -1 : strtol(value, &end, 10);
 
-	for (int i = 0; i < ALIEN_TYPE; i++) {
-		for (int j = 0; j < ALIEN_POPULATION; j++) {
-			free(game->alien[i][j].sprite.texture);
+	if (value == NULL || *end != '\0' || n < min || n > max) {
+		fprintf(stderr, "%s: Option %s needs a number from %d to %d.\n", game->title, option, min, max);
+		return 1;
+	}
+
+	*number = n;
+	return 0;
+}
+
+static int parse_options(Game *game, int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		int status;
+
+		if (strcmp(argv[i], "-t") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 1, 1000, &game->tick_rate);
+		} else if (strcmp(argv[i], "-f") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 0, 1000, &game->frame_rate);
+		} else if (strcmp(argv[i], "-a") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 1, MAX_ALIEN_POPULATION, &game->alien_count);
+		} else if (strcmp(argv[i], "-m") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 0, 4096, &game->atlas.budget);
+		} else if (strcmp(argv[i], "-R") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], resolution_scale(RESOLUTION_STEPS - 1), 100, &game->resolution.lowest_scale);
+		} else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "-p") == 0) && i + 1 < argc) {
+			game->replay.path = argv[i + 1];
+			game->replay.is_playing = argv[i][1] == 'p';
+			status = 0;
+		} else if (strcmp(argv[i], "-H") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 1, 65535, &game->net.port);
+			game->net.is_active = game->net.is_host = SDL_TRUE;
+		} else if (strcmp(argv[i], "-J") == 0 && i + 1 < argc) {
+			game->net.address = argv[i + 1];
+			game->net.is_active = SDL_TRUE;
+			status = 0;
+		} else if (strcmp(argv[i], "-L") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 0, 1000, &game->net.latency);
+		} else if (strcmp(argv[i], "-D") == 0) {
+			status = parse_number(game, argv[i], argv[i + 1], 0, 100, &game->net.loss);
+		} else if (strcmp(argv[i], "-u") == 0) {
+			game->dirty.is_enabled = SDL_TRUE;
+			status = 0;
+			i--; // Takes no value.
+		} else if (strcmp(argv[i], "-S") == 0) {
+			game->starfield.is_enabled = SDL_TRUE;
+			status = 0;
+			i--; // Takes no value.
+		} else if (strcmp(argv[i], "-P") == 0) {
+			game->pacer.show_stats = SDL_TRUE;
+			status = 0;
+			i--; // Takes no value.
+		} else {
+			fprintf(stderr, "Usage: %s [-t ticks per second] [-f frames per second, 0 for no limit] [-P print frame pacing statistics] [-a aliens of each type] [-m texture MiB, 0 for no limit] [-R lowest render scale percent] [-S starfield for the background] [-u draw only what changes] [-r record to file | -p play back file] [-H host on port | -J join host:port] [-L added latency ms] [-D percent of packets dropped]\n", argv[0]);
+			return 1;
 		}
 
-		free_sprite(&game->alien_sprite[i]);
-	}
+		if (status != 0) {
+			return status;
+		}
 
-	for (int i = 0; i < 10; i++) {
-		SDL_DestroyTexture(game->score.digit[i]);
+		i++;
 	}
 
-	for (int i = 0; i < PAUSE_MSG; i++) {
-		SDL_DestroyTexture(game->paused_message[i]);
+	if (game->net.is_active && (game->replay.path != NULL || (game->net.is_host && game->net.address != NULL))) {
+		fprintf(stderr, "%s: Host or join a game, not both, and without recording or playing back.\n", game->title);
+		return 1;
 	}
 
-	SDL_DestroyRenderer(game->renderer);
-	SDL_DestroyWindow(game->window);
-	TTF_Quit();
-	SDL_Quit();
+	return 0;
 }
 
 int main(int argc, char *argv[])
 {
 	Game game;
 	init_game(&game);
-	int status = init(&game);
 
-	if (status != 0) {
+	if (parse_options(&game, argc, argv) != 0 || start_replay(&game, time(NULL)) != 0 || connect_net(&game, time(NULL)) != 0) {
 		return 1;
 	}
 
-	init_audio(&game);
+	// Decode the images and sounds on other threads while SDL starts up.
+	start_loading(&game, SDL_TRUE);
+	int status = init(&game);
 
-	if (game.audio.id != 0) {
-		load_audio(&game, DATADIR"/explode.wav");
+	if (status == 0) {
+		init_audio(&game);
+
+		if (game.audio.id != 0) {
+			load_audio(&game, SOUND_EXPLODE);
+
+			if (start_music(&game, DATADIR"/"MUSIC_OGG_FILE) != 0) {
+				start_music(&game, DATADIR"/"MUSIC_FILE);
+			}
+
+			SDL_PauseAudioDevice(game.audio.id, 0);
+		}
+
+		status = init_sprites(&game);
+		start_workers(&game, 0);
+	}
+
+	if (status == 0) {
+		status = start_net_game(&game);
+	}
+
+	if (status == 0) {
+		status = start_simulation(&game);
+	}
+
+	if (status != 0) {
+		finish_replay(&game);
+		close_net(&game);
+		finish_loading(&game);
+		return 1;
 	}
 
 	SDL_ShowCursor(SDL_DISABLE);
 	play_game(&game);
+	end_simulation(&game);
+	stop_workers(&game);
 	SDL_ShowCursor(SDL_ENABLE);
+	print_pacer_stats(&game);
+	finish_replay(&game);
+	close_net(&game);
 	TTF_CloseFont(game.font);
 
 	if (game.audio.id != 0) {
@@ -1730,7 +1002,7 @@ int main(int argc, char *argv[])
 	}
 
 	free_graphics(&game);
+	finish_loading(&game);
 
 	return 0;
 }
-
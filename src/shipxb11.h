@@ -0,0 +1,906 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHIPXB11_H
+#define SHIPXB11_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define ALIEN_POPULATION 10
+#define ALIEN_TYPE 4
+#define ATLAS_GROUPS ALIEN_TYPE
+#define ATLAS_PADDING 1
+#define ATLAS_SIZE 2048
+#define AUDIO_COMMANDS 64
+#define AUDIO_SAMPLES 512
+#define BIGBLUE_SPREAD 5
+#define DIRTY_TILE 32
+#define ENTITY_EXPLODING 0x2
+#define ENTITY_FIRING 0x4
+#define ENTITY_VISIBLE 0x1
+#define FIRE_KEY 0x2
+#define FIRST_GLYPH ' '
+#define FPS 60
+#define GAME_TITLE "Ship XB11"
+#define GLYPHS 95
+#define GLYPH_ATLAS_WIDTH 512
+#define GRID_CELL_SIZE 64
+#define GRID_MIN_QUERIES 10
+#define HEIGHT 800
+#define LEFT_KEY 0x4
+#define LINE_Y 70
+#define MAX_ALIEN_POPULATION 10000
+#define MAX_ATLAS_PAGES 8
+#define MAX_CATCH_UP_TICKS 8
+#define MAX_LOAD_THREADS 8
+#define MAX_SNAPSHOT_REGIONS 48
+#define MAX_TASK_CHUNKS 64
+#define MAX_VOICES 16
+#define MAX_WORKERS 8
+#define MUSIC_CHUNK 16384
+#define MUSIC_FILE "music.wav"
+#define MUSIC_GAIN 0.5
+#define MUSIC_OGG_FILE "music.ogg"
+#define MUSIC_RING 32768
+#define NET_CONNECT_TIMEOUT 60000
+#define NET_INPUT_DELAY 2
+#define NET_INPUTS 64
+#define NET_PACKET_SIZE 80
+#define NET_QUEUE 256
+#define NET_RESEND_MS 10
+#define NET_ROLLBACK 8
+#define NET_TIMEOUT 5000
+#define NET_VERSION 1
+#define NO_KEY 0
+#define PACER_HISTORY 256
+#define PACER_SHORT_PRESENTS 30
+#define PACK_ALIGN 64
+#define PACK_FILE "shipxb11.pack"
+#define PACK_MAGIC "SXB11PAK"
+#define PACK_NAME_SIZE 32
+#define PACK_VERSION 1
+#define PAUSE_DIM 160
+#define PAUSE_MSG 5
+#define PLAYER_FIRE_DELAY 10
+#define PLAYERS 2
+#define PROFILE_EVENTS 16384
+#define PROFILE_FRAMES 150
+#define PROFILE_TRACE_FILE "shipxb11-trace.json"
+#define PROJECTILE_LIFE 600
+#define PROJECTILE_POOL_SIZE 4096
+#define QUARTERS 4
+#define REPLAY_END 0x80
+#define REPLAY_KEYS (FIRE_KEY | LEFT_KEY | RIGHT_KEY | TAP_KEY)
+#define REPLAY_MAGIC "SXB11REP"
+#define REPLAY_RESTART 0x10
+#define REPLAY_VERSION 1
+#define RESOLUTION_HOLD 30
+#define RESOLUTION_STEPS 4
+#define RIGHT_KEY 0x1
+#define SCENE_FRESH 0x4
+#define SCENES 3
+#define SNAP_DISTANCE 16
+#define STAR_LAYERS 3
+#define STARFIELD_SEED 0x2545f491
+#define TASK_GRAIN 512
+#define TAP_KEY 0x8
+#define TEXTURE_BUDGET 64
+#define TICK_RATE 60
+#define WIDTH 600
+
+#define set_rect(R, X, Y, W, H) R.x = X; R.y = Y; R.w = W; R.h = H
+
+/*
+	Zone timers for the frame profiler, built with -DSHIPXB11_PROFILE. Put
+	PROFILE_BEGIN(zone) and PROFILE_END(game, zone) around a step, in the
+	same block. Without the define they compile to nothing.
+*/
+#ifdef SHIPXB11_PROFILE
+#define PROFILE_BEGIN(zone) Uint64 profile_##zone = SDL_GetPerformanceCounter()
+#define PROFILE_END(game, zone) record_zone(&(game)->profiler, #zone, profile_##zone)
+#define PROFILE_FRAME(game) profile_frame(game)
+#define PROFILE_GRAPH(game) draw_frame_graph(game)
+#else
+#define PROFILE_BEGIN(zone) (void)0
+#define PROFILE_END(game, zone) (void)0
+#define PROFILE_FRAME(game) (void)0
+#define PROFILE_GRAPH(game) (void)0
+#endif
+
+typedef struct {
+	SDL_AudioSpec audio_spec;
+	SDL_bool converted;
+	Uint8 *wave_buffer; // Stereo frames of signed 16 bit samples at the device rate, once loaded.
+	Uint32 wave_length;
+} AudioInfo;
+
+enum {
+	SOUND_EXPLODE,
+	SOUNDS
+};
+
+typedef struct {
+	const Sint16 *sample; // NULL for a free voice.
+	Uint32 frames;
+	Uint32 position;
+	Uint64 started; // Callback count when the voice started, the oldest is taken when none are free.
+	Sint16 gain[2]; // Left and right, 32767 for full volume.
+} Voice;
+
+typedef struct {
+	int sound;
+	Sint16 gain[2];
+} AudioCommand;
+
+/*
+	Background music, decoded on its own thread into a ring of samples at the
+	device's rate. The thread only writes ring_tail and the audio callback
+	only writes ring_head.
+*/
+typedef struct {
+	SDL_RWops *file;
+	void *vorbis; // The OggVorbis_File decoding the file, NULL for WAV.
+	Sint64 data_start; // Offset of the first sample in the file.
+	Uint32 data_length; // Whole frames only.
+	Uint32 position; // Bytes read from the data chunk.
+	int frame_size;
+	SDL_AudioStream *stream; // Converts to the device's format and rate.
+	Uint8 *chunk; // Room for MUSIC_CHUNK bytes read from the file.
+	Uint32 chunk_size; // Bytes read at a time, in whole frames.
+	Sint16 *ring; // MUSIC_RING samples.
+	SDL_atomic_t ring_head; // Next sample for the callback to read.
+	SDL_atomic_t ring_tail; // Next free sample for the decoder to write.
+	SDL_sem *consumed; // Posted by the callback whenever it reads from the ring.
+	SDL_Thread *thread;
+	SDL_atomic_t is_stopping;
+	Sint16 gain;
+	int underruns; // Callbacks that found the ring short, once it had been filled.
+	SDL_bool has_started;
+} Music;
+
+/*
+	The game thread only writes command_tail and the commands it publishes,
+	and the audio callback only writes command_head and the voices, so the
+	two never share a lock.
+*/
+typedef struct {
+	AudioInfo audio_info[SOUNDS];
+	SDL_AudioDeviceID id;
+	SDL_AudioSpec device_spec;
+	AudioCommand command[AUDIO_COMMANDS];
+	SDL_atomic_t command_head; // Next command for the callback to read.
+	SDL_atomic_t command_tail; // Next free slot for the game thread to write.
+	int dropped_sounds; // Commands lost to a full ring.
+	SDL_bool is_muted; // While ticks that were already heard are simulated again.
+	// Audio callback state.
+	Voice voice[MAX_VOICES];
+	Uint64 callbacks;
+	Uint64 last_callback; // Performance counter at the last callback.
+	int late_callbacks; // More than two buffers apart, most likely an underrun.
+	int stolen_voices;
+	Music music;
+} Audio;
+
+typedef struct {
+	SDL_Rect rect; // Source rectangle within the atlas page.
+	int page;
+} Frame;
+
+typedef struct {
+	SDL_Surface *surface;
+	Frame *frame;
+} AtlasEntry;
+
+/*
+	Asset pack written by shipxb11-pack, in the byte order of the machine
+	that built it: a PackHeader, the PackSprites, the PackImages, then the
+	pixels of each image, every block starting on a PACK_ALIGN boundary.
+*/
+typedef struct {
+	char magic[8]; // PACK_MAGIC, without the terminating NUL.
+	Uint32 version;
+	Uint32 sprite_count;
+	Uint32 image_count;
+	Uint32 reserved;
+} PackHeader;
+
+typedef struct {
+	char name[PACK_NAME_SIZE]; // Name the game loads the sprite by, e.g. "bigblue.png".
+	Uint32 first_image;
+	Uint32 frame_count;
+} PackSprite;
+
+typedef struct {
+	Uint32 width;
+	Uint32 height;
+	Uint32 pitch;
+	Uint32 format; // SDL_PIXELFORMAT_RGBA32, or SDL_PIXELFORMAT_RGB888 for images with no alpha.
+	Uint64 offset; // Of the pixels, from the start of the pack.
+} PackImage;
+
+// Aliens and asteroid quarters are in the order they are stored in Game.
+enum {
+	IMAGE_BIGBLUE,
+	IMAGE_PLAYER,
+	IMAGE_PURPLE,
+	IMAGE_GREEN,
+	IMAGE_YELLOW,
+	IMAGE_CYAN,
+	IMAGE_BACKGROUND,
+	IMAGE_EXPLOSION,
+	IMAGE_MISSILE,
+	IMAGE_PLAYMIS,
+	IMAGE_LINE,
+	IMAGE_ASTEROID,
+	IMAGE_UL,
+	IMAGE_UR,
+	IMAGE_LL,
+	IMAGE_LR,
+	IMAGES
+};
+
+enum {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE
+};
+
+// Decoding of one image, all its frames, or one sound. Jobs 0 to IMAGES - 1 are the images, then the sounds.
+typedef struct {
+	const char *path;
+	int state; // Guarded by Loader.lock.
+	PackSprite *pack_sprite; // Set for an image the asset pack already holds decoded, which needs no job.
+	int frame_count;
+	SDL_Surface **frame;
+	SDL_AudioSpec audio_spec;
+	Uint8 *wave_buffer;
+	Uint32 wave_length;
+} LoadJob;
+
+// Threads stay for the whole game, so images can be decoded again after their textures are evicted.
+typedef struct {
+	SDL_bool is_stopping;
+	int job_count;
+	int thread_count;
+	LoadJob job[IMAGES + SOUNDS];
+	SDL_Thread *thread[MAX_LOAD_THREADS];
+	SDL_mutex *lock;
+	SDL_cond *job_done;
+	SDL_cond *work_ready;
+} Loader;
+
+typedef struct {
+	void *data; // NULL when no pack is open.
+	size_t size;
+	SDL_bool is_mapped;
+	PackHeader *header;
+	PackSprite *sprite;
+	PackImage *image;
+} AssetPack;
+
+enum {
+	LAYER_BACKGROUND,
+	LAYER_SPRITES,
+	LAYER_HUD
+};
+
+typedef struct {
+	SDL_Texture *texture;
+	SDL_Rect srect;
+	SDL_Rect drect;
+	SDL_Color colour; // The texture's colour and alpha mod when queued, which geometry does not apply by itself.
+	int layer;
+	int sequence; // Submission order, keeps the sort stable.
+} DrawCommand;
+
+typedef struct {
+	int capacity;
+	int count;
+	int draw_calls; // Submissions made by the last flush.
+	DrawCommand *command;
+	DrawCommand *clipped; // The commands that touch one dirty rectangle.
+	SDL_Vertex *vertex;
+	int *index;
+} RenderQueue;
+
+/*
+	With -u only the parts of the window that change are drawn, and only
+	they are updated on the window, see dirty.c. The window is split into
+	tiles, and a tile is redrawn if anything was drawn on it this frame or
+	the last.
+*/
+typedef struct {
+	SDL_bool is_enabled;
+	SDL_bool is_full; // Draw and update the whole window next frame.
+	int columns;
+	int rows;
+	Uint8 *drawn[2]; // Tiles with a sprite or the HUD on them, columns by rows, this frame and the last.
+	int current; // Index in drawn of this frame's tiles.
+	SDL_Rect *rect; // To redraw and update this frame.
+	int count;
+} DirtyRects;
+
+/*
+	Paces the frames to the display, see pacer.c. Times are in performance
+	counter ticks.
+*/
+typedef struct {
+	int refresh_rate; // Of the window's display, 0 if it is not known.
+	int rate; // Frames per second paced to, 0 for no limit.
+	SDL_bool has_vsync; // Present waits for the display, so there is nothing to wait for here.
+	SDL_bool show_stats; // Print the statistics on exit.
+	Uint64 period;
+	Uint64 deadline; // When the next frame should start.
+	Uint64 last_frame; // When the last frame started.
+	Uint64 spin; // Left to spin after a sleep, from how late sleeps wake.
+	int short_presents; // Presents in a row that came back too soon for vsync.
+	long frames;
+	long missed; // Frames that started late, or a whole refresh late with vsync.
+	double jitter_total;
+	double jitter_max;
+	float jitter[PACER_HISTORY]; // Milliseconds each of the last frames started off the beat.
+} Pacer;
+
+/*
+	The scene is drawn smaller, and scaled up to the window, while frames
+	take too long to draw at full size, see resolution.c.
+*/
+typedef struct {
+	int lowest_scale; // Percent of full size the scene may go down to, 0 to choose by renderer.
+	int step; // Index into the resolution steps, 0 being full size straight to the window.
+	int frames_at_step;
+	double frame_time; // Moving average of the seconds a frame takes to draw and present.
+	SDL_Texture *target; // The scene below full size, NULL if it is never scaled.
+	SDL_bool is_drawing_target;
+} Resolution;
+
+typedef struct {
+	int count;
+	int speed; // Pixels it scrolls for each pixel of the background's scroll.
+	int size; // Of each star, in pixels. Stars of size 1 are drawn as points.
+	Uint8 brightness;
+	SDL_Point *star; // Positions before scrolling.
+} StarLayer;
+
+// Drawn in place of the background image with -S, see starfield.c.
+typedef struct {
+	SDL_bool is_enabled;
+	StarLayer layer[STAR_LAYERS];
+	double scroll; // Of the background, for the frame being drawn.
+	SDL_Point *point; // A layer's stars as scrolled this frame.
+	SDL_Rect *rect;
+} Starfield;
+
+typedef struct {
+	SDL_bool is_animated;
+	SDL_bool is_visible;
+	double dx;
+	double dy;
+	double x;
+	double y;
+	double prev_x; // Position at the start of the current tick, for interpolation.
+	double prev_y;
+	int current_frame;
+	int frame_count;
+	int frame_delay;
+	int next_frame_time;
+	int width;
+	int height;
+	Frame *frame; // One entry per animation frame, shared by copies of the sprite. Kept last, see snapshot.c.
+} Sprite;
+
+// Images that become resident together. Group 0 is everything the first level needs, group i alien type i.
+typedef struct {
+	SDL_bool is_resident;
+	Uint32 pages; // Bit mask of the Atlas.page slots holding the group.
+	size_t bytes; // Texture memory of those pages, kept after eviction as the cost of building them again.
+	Uint64 last_needed; // Atlas.clock when the group was last needed.
+} AtlasGroup;
+
+typedef struct {
+	int budget; // Texture memory to stay within in MiB, 0 for no limit.
+	int entry_count;
+	AtlasEntry *entry; // Frames waiting to be packed by build_group().
+	size_t resident_bytes;
+	Uint64 clock; // Calls to update_residency().
+	AtlasGroup group[ATLAS_GROUPS];
+	Sprite *sprite[IMAGES]; // Sprite holding the frames of each image.
+	int steps; // Resolution steps the pages are pre-scaled for, 1 for full size only.
+	SDL_Texture *page[RESOLUTION_STEPS][MAX_ATLAS_PAGES]; // Each page at each step. NULL for a free slot.
+} Atlas;
+
+typedef struct {
+	SDL_bool is_exploding;
+	Sprite sprite;
+} Craft;
+
+// The craft comes last, so everything before its frame pointer can be copied as one block.
+typedef struct {
+	unsigned int key; // LEFT_KEY, RIGHT_KEY, FIRE_KEY and TAP_KEY held for this tick.
+	int fire_delay; // Ticks until the player can fire again.
+	int launcher; // Which of the four launchers fires next.
+	int steer_x; // Where the ship is heading, moved by the direction keys.
+	Craft craft;
+} Player;
+
+enum {
+	OWNER_PLAYER,
+	OWNER_ALIEN,
+	OWNER_BIGBLUE,
+	OWNERS
+};
+
+typedef struct {
+	double x;
+	double y;
+	double dx;
+	double dy;
+	double prev_x;
+	double prev_y;
+	int owner;
+	int life; // Ticks left, 0 for a free slot.
+	int next_free;
+} Projectile;
+
+typedef struct {
+	int capacity;
+	int end; // One past the highest slot that may be live.
+	int first_free; // Head of the free list, -1 when the pool is full.
+	int owned[OWNERS]; // Live projectiles of each owner.
+	Projectile *projectile;
+	int *hit; // Scratch for the parallel passes over the pool, a result for each slot.
+} ProjectilePool;
+
+typedef struct {
+	int current_frame;
+	int next_frame_time;
+	int type; // Index of the sprite holding the frames, e.g. into Game.alien_sprite.
+} EntityAnimation;
+
+// Structure of arrays, so that a pass over one field streams through memory.
+typedef struct {
+	int capacity;
+	int count; // Entities in use, always the first count slots.
+	double *x;
+	double *y;
+	double *dx;
+	double *dy;
+	int *width;
+	int *height;
+	Uint8 *flags; // ENTITY_VISIBLE and ENTITY_EXPLODING, and ENTITY_FIRING within move_aliens().
+	// Cold data, only needed to draw a frame.
+	double *prev_x;
+	double *prev_y;
+	EntityAnimation *animation;
+	Uint64 *hit_mask; // Scratch for collide_boxes().
+	Uint32 *random; // Scratch for move_aliens(), two random numbers per entity.
+} EntityStore;
+
+// Uniform grid over the playfield, rebuilt from an EntityStore when needed.
+typedef struct {
+	SDL_bool is_built; // Built from the store's current positions.
+	int columns;
+	int rows;
+	int max_width; // Largest entity in the grid.
+	int max_height;
+	int *cell_start; // Cell c holds item[cell_start[c]] to item[cell_start[c + 1] - 1].
+	int *cell; // Cell of each entity, -1 when not in the grid.
+	int *item; // Entity indices, in store order within each cell.
+	int *chunk_start; // Each chunk's count, then next slot, in each cell, for a parallel rebuild.
+	int chunk_max_width[MAX_TASK_CHUNKS];
+	int chunk_max_height[MAX_TASK_CHUNKS];
+} SpatialGrid;
+
+typedef struct {
+	int score_digit[7];
+	int high_digit[7];
+	int high;
+	int score;
+	int visible_high;
+	int visible_score;
+} Score;
+
+#ifdef SHIPXB11_PROFILE
+typedef struct {
+	const char *name;
+	Uint64 start;
+	Uint64 end;
+	SDL_threadID thread;
+	SDL_atomic_t sequence; // Number of the event in the slot, or -1 while it is written. Readers check it before and after copying the slot.
+} ProfileEvent;
+
+// Any thread may record zones, each claims its slot in the ring with one atomic add.
+typedef struct {
+	ProfileEvent event[PROFILE_EVENTS];
+	SDL_atomic_t next_event;
+	Uint64 origin; // Time zero in the trace.
+	Uint64 frame_start;
+	float frame_ms[PROFILE_FRAMES]; // Ring of the last frame times, for the graph.
+	int frame;
+	SDL_bool show_graph;
+} Profiler;
+#endif
+
+struct Game;
+
+// Runs on items start to end - 1 of chunk, on the thread numbered worker, 0 being the caller's.
+typedef void (*TaskFunction)(struct Game *game, void *data, int chunk, int start, int end, int worker);
+
+typedef struct {
+	TaskFunction run;
+	void *data;
+	int chunk;
+	int start;
+	int end;
+} Task;
+
+// The owner takes from the bottom, the others steal from the top.
+typedef struct {
+	SDL_SpinLock lock;
+	int top;
+	int bottom;
+	Task task[MAX_TASK_CHUNKS];
+} TaskDeque;
+
+/*
+	Threads that share out the chunks of a parallel_for(), see scheduler.c.
+	Worker 0 is the thread that calls it, which works too.
+*/
+typedef struct {
+	int worker_count; // 1 or less runs everything on the caller.
+	SDL_Thread *thread[MAX_WORKERS];
+	TaskDeque deque[MAX_WORKERS];
+	SDL_atomic_t pending; // Tasks of the current parallel_for() not yet finished.
+	SDL_atomic_t started; // Hands the threads their worker numbers.
+	SDL_atomic_t is_stopping;
+	SDL_sem *work_ready;
+	Uint64 *hit_mask[MAX_WORKERS]; // Scratch for each worker's collide_boxes() and query_grid(), worker 0 uses the store's.
+} Scheduler;
+
+/*
+	A recorded session: a header of REPLAY_MAGIC, REPLAY_VERSION, the seed
+	and alien_count, then a record each time the input changes from one
+	tick to the next. A record is the ticks since the last one and a byte of
+	REPLAY_KEYS, REPLAY_RESTART and REPLAY_END. The end record is followed
+	by hash_game_state() at the end. Numbers are unsigned LEB128 varints.
+*/
+typedef struct {
+	SDL_RWops *file; // NULL unless recording or playing back.
+	const char *path;
+	SDL_bool is_playing;
+	SDL_bool has_hash; // Playing back: the end record was read.
+	SDL_bool restart; // Recording: the game was restarted since the last tick.
+	long tick; // Ticks recorded or played back so far.
+	long change_tick; // Recording: tick of the last record. Playing back: tick of the next one.
+	unsigned int input; // Of the current tick.
+	unsigned int next_input; // Playing back: of the next record.
+	Uint64 hash; // Playing back: the game state at the end of the recording.
+} Replay;
+
+typedef struct {
+	Uint8 data[NET_PACKET_SIZE];
+	int length;
+	Uint32 due; // SDL_GetTicks() when it goes out.
+} NetPacket;
+
+/*
+	A two player game over UDP, kept in step by rolling back, see net.c.
+	Inputs are bytes of REPLAY_KEYS and REPLAY_RESTART in a ring by tick.
+*/
+typedef struct {
+	SDL_bool is_active;
+	SDL_bool is_host;
+	const char *address; // host:port of the game to join.
+	int port; // To host the game on.
+	Uint64 seed; // The host's, sent to whoever joins.
+	intptr_t socket;
+	Uint32 peer_host; // IPv4 address and port of the other player, in network byte order.
+	Uint16 peer_port;
+	int local; // Index of this side's player.
+	long tick; // Next tick to simulate.
+	long local_end; // Ticks below this have this side's input.
+	long remote_end; // Ticks below this have the other player's input, the rest are guessed.
+	long peer_ack; // The other player has this side's input for ticks below this.
+	long first_wrong; // Earliest tick simulated with a wrong guess, or -1.
+	SDL_bool restart; // N was pressed since the last tick.
+	Uint8 input[PLAYERS][NET_INPUTS];
+	Uint8 *state; // NET_ROLLBACK + 1 snapshots of the state before a tick, by tick.
+	Uint32 last_heard; // SDL_GetTicks() of the last packet from the other player.
+	Uint32 last_sent;
+	// Simulated network conditions, for testing on one machine.
+	int latency; // Milliseconds every packet is held back.
+	int loss; // Percent of packets dropped.
+	Uint32 random_state; // Of xorshift32(), for the packets dropped.
+	NetPacket queue[NET_QUEUE]; // Packets held back, in the order they go out.
+	int queue_count;
+	long rollbacks;
+	long resimulated; // Ticks simulated again.
+	long stalls; // Times net_tick() waited for the other player.
+	long dropped;
+} NetSession;
+
+typedef struct {
+	void *data;
+	size_t size;
+} SnapshotRegion;
+
+// Where the state update_game() and reset_game() change lives, copied as one flat buffer by save_snapshot().
+typedef struct {
+	int region_count;
+	size_t size; // Of a snapshot, in bytes.
+	SnapshotRegion region[MAX_SNAPSHOT_REGIONS];
+} SnapshotLayout;
+
+// A frame to draw between its positions at the last two ticks.
+typedef struct {
+	Frame *frame;
+	double x;
+	double y;
+	double prev_x;
+	double prev_y;
+	int width;
+	int height;
+} SceneItem;
+
+// What the simulation thread hands the render thread to draw, copied out of Game after its ticks.
+typedef struct {
+	Uint64 tick_time; // Performance counter at the last tick, the start of the interpolation.
+	SDL_bool is_game_over; // The simulation has stopped for the game over screen.
+	double background_y;
+	double background_prev_y;
+	int alien_type;
+	int lives;
+	int score_digit[7];
+	int high_digit[7];
+	SceneItem ship; // For the lives.
+	int players;
+	int player_item[PLAYERS]; // Item each ship is drawn by, -1 when it is not.
+	int item_count;
+	int item_capacity;
+	SceneItem *item; // In the order they are drawn.
+} Scene;
+
+/*
+	The simulation on its own thread, see scene.c. It publishes a Scene after
+	its ticks through a triple buffer: it fills scene[back], then swaps it
+	with ready, and the render thread swaps ready with scene[front] when it
+	is marked SCENE_FRESH. The lock and condition are only for stopping the
+	thread, while Game belongs to the render thread for pauses and restarts.
+*/
+typedef struct {
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *changed;
+	SDL_atomic_t stop; // Set by either thread, the simulation parks at the next tick.
+	SDL_atomic_t has_ended; // The other player in a network game has gone.
+	SDL_atomic_t key; // Keyboard for the local player, TAP_KEY is cleared when a tick takes it.
+	SDL_bool is_parked; // Guarded by lock.
+	SDL_bool is_quitting; // Guarded by lock.
+	SDL_bool is_running; // Render thread only: the simulation has been let run.
+	Scene scene[SCENES];
+	SDL_atomic_t ready; // Index of the scene between the threads, with SCENE_FRESH if it is new.
+	int back; // Simulation thread only.
+	int front; // Render thread only.
+} SimThread;
+
+typedef struct {
+	SDL_Rect rect; // Source rectangle within the glyph atlas, as tall as the font.
+	int offset; // From the pen position to the left of rect, negative where the glyph overhangs.
+	int advance;
+} Glyph;
+
+// The printable ASCII characters of the game font, rendered once into one texture.
+typedef struct {
+	SDL_Texture *texture;
+	int height;
+	Glyph glyph[GLYPHS];
+	Sint8 kerning[GLYPHS][GLYPHS]; // Added to the advance from the first glyph to the second.
+} GlyphAtlas;
+
+typedef struct Game {
+	Atlas atlas;
+	AssetPack pack; // Open only while loading.
+	Audio audio;
+	double alpha; // How far the displayed frame is between the previous tick and the current one.
+	SDL_bool paused;
+	const char *title;
+	Craft asteroid;
+	Craft bigblue;
+	Player player[PLAYERS];
+	int players; // 1, or 2 in a network game.
+	Craft quarter[QUARTERS]; // Broken asteroid: upper left, upper right, lower left, lower right.
+	EntityStore aliens; // Row by row, alien_count of each type.
+	SpatialGrid alien_grid;
+	int alien_count; // Aliens of each type.
+	int alien_type;
+	int bigblue_hit_time; // Ticks since Big Blue was woken by a hit.
+	int frame_rate; // From -f, 0 for no limit, or -1 for the display's refresh rate.
+	int height;
+	int level;
+	int lives;
+	Loader loader;
+	NetSession net;
+	Pacer pacer;
+	int qcount; // Number of visible quarter asteroid pieces.
+	Uint64 random_state; // Of next_random(), the simulation's only source of random numbers.
+	int tick_rate;
+	int width;
+	ProjectilePool projectiles;
+#ifdef SHIPXB11_PROFILE
+	Profiler profiler;
+#endif
+	RenderQueue queue;
+	Replay replay;
+	Resolution resolution;
+	DirtyRects dirty;
+	Starfield starfield;
+	Scheduler scheduler;
+	Score score;
+	SimThread sim;
+	SnapshotLayout snapshot;
+	Sprite alien_sprite[ALIEN_TYPE];
+	Sprite background;
+	Sprite explosion;
+	Sprite line;
+	Sprite missile; // Frames for alien and Big Blue projectiles.
+	Sprite playmis; // Frames for player projectiles.
+	GlyphAtlas text;
+	SDL_Texture *pause_screen; // The frozen frame, drawn into it once on each pause, NULL without target textures.
+	Scene *paused_scene; // The scene of the frozen frame, NULL at the title screen.
+	SDL_Renderer *renderer;
+	SDL_Window *window;
+	TTF_Font *font;
+} Game;
+
+/* audio.c */
+void init_audio(Game *game);
+int load_audio(Game *game, int sound);
+void play_sound(Game *game, int sound, double gain, double pan);
+void close_audio(Game *game);
+void mix_samples(Sint16 *out, const Sint16 *in, int count, Sint16 left, Sint16 right);
+
+/* collide.c */
+void collide_boxes(EntityStore *store, double x, double y, int width, int height, Uint64 *mask);
+void init_grid(Game *game, SpatialGrid *grid, int capacity);
+void free_grid(SpatialGrid *grid);
+void build_grid(Game *game, SpatialGrid *grid, EntityStore *store);
+void query_grid(SpatialGrid *grid, EntityStore *store, double x, double y, int width, int height, Uint64 *mask);
+
+/* dirty.c */
+SDL_Renderer *create_dirty_renderer(Game *game);
+void find_dirty_rects(Game *game, const DrawCommand *command, int count);
+void present_dirty_rects(Game *game);
+void free_dirty_rects(Game *game);
+
+/* loader.c */
+void start_loading(Game *game, SDL_bool load_sounds);
+SDL_bool prefetch_job(Game *game, int job);
+LoadJob *wait_for_job(Game *game, int job);
+void finish_loading(Game *game);
+
+/* music.c */
+int start_music(Game *game, const char *path);
+void mix_music(Music *music, Sint16 *out, int count);
+void stop_music(Game *game);
+
+/* net.c */
+int connect_net(Game *game, Uint64 seed);
+int start_net_game(Game *game);
+int net_tick(Game *game);
+int settle_net(Game *game);
+void close_net(Game *game);
+
+/* pack.c */
+int open_pack(Game *game, AssetPack *pack, const char *path);
+void close_pack(AssetPack *pack);
+PackSprite *find_pack_sprite(AssetPack *pack, const char *name);
+
+/* pacer.c */
+Uint32 init_pacer(Game *game);
+void start_pacer(Game *game);
+void pace_frame(Game *game);
+void print_pacer_stats(Game *game);
+
+#ifdef SHIPXB11_PROFILE
+/* profile.c */
+void init_profiler(Game *game);
+void record_zone(Profiler *profiler, const char *name, Uint64 start);
+void profile_frame(Game *game);
+void draw_frame_graph(Game *game);
+SDL_bool handle_profiler_key(Game *game, SDL_Scancode key);
+#endif
+
+/* projectile.c */
+void init_projectile_pool(Game *game, ProjectilePool *pool, int capacity);
+void free_projectile_pool(ProjectilePool *pool);
+void clear_projectiles(ProjectilePool *pool);
+Projectile *spawn_projectile(ProjectilePool *pool, int owner, double x, double y, double dx, double dy);
+void remove_projectile(ProjectilePool *pool, Projectile *projectile);
+void trim_projectiles(ProjectilePool *pool);
+
+/* replay.c */
+int start_replay(Game *game, Uint64 seed);
+int replay_input(Game *game);
+int finish_replay(Game *game);
+
+/* resolution.c */
+void init_resolution(Game *game);
+void begin_scene(Game *game);
+void finish_scene(Game *game);
+SDL_Texture *create_scene_target(Game *game);
+void adapt_resolution(Game *game, Uint64 frame_ticks);
+void free_resolution(Game *game);
+
+/* scene.c */
+int start_simulation(Game *game);
+void stop_simulation(Game *game);
+void resume_simulation(Game *game);
+Scene *latest_scene(Game *game);
+void change_keys(Game *game, unsigned int clear, unsigned int set);
+void end_simulation(Game *game);
+
+/* scheduler.c */
+void start_workers(Game *game, int workers);
+int task_chunks(Game *game, int count);
+void parallel_for(Game *game, int count, TaskFunction run, void *data);
+Uint64 *worker_hit_mask(Game *game, int worker);
+void stop_workers(Game *game);
+
+/* sim.c */
+void seed_random(Game *game, Uint64 seed);
+Uint32 xorshift32(Uint32 *state);
+void *allocate(Game *game, size_t size, const char *caller);
+void init_game(Game *game);
+void reset_game(Game *game);
+void init_craft(Craft *craft);
+void set_players(Game *game, int players);
+void init_entity_store(Game *game, EntityStore *store, int capacity);
+void free_entity_store(EntityStore *store);
+void reset_aliens(Game *game);
+void reset_bigblue(Game *game);
+void animate_sprite(Sprite *sprite);
+Sprite *projectile_sprite(Game *game, Projectile *projectile);
+void update_game(Game *game);
+Uint64 hash_game_state(Game *game);
+
+/* snapshot.c */
+void init_snapshot(Game *game);
+void save_snapshot(Game *game, Uint8 *buffer);
+void load_snapshot(Game *game, const Uint8 *buffer);
+
+/* sprites.c */
+int init_sprites(Game *game);
+int update_residency(Game *game, int alien_type);
+void free_sprites(Game *game);
+int resolution_scale(int step);
+void scale_rect(const SDL_Rect *rect, int step, SDL_Rect *scaled);
+
+/* starfield.c */
+void init_starfield(Game *game);
+void draw_starfield(Game *game);
+void free_starfield(Game *game);
+
+/* text.c */
+int init_text(Game *game);
+Glyph *find_glyph(GlyphAtlas *text, char c);
+int glyph_kerning(GlyphAtlas *text, char previous, char c);
+int text_width(GlyphAtlas *text, const char *string);
+void free_text(Game *game);
+
+#endif
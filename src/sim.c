@@ -0,0 +1,1233 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+void init_game(Game *game)
+{
+	for (int i = 0; i < 7; i++) {
+		game->score.high_digit[i] = 0;
+	}
+
+	game->paused = SDL_TRUE;
+	game->title = GAME_TITLE;
+	game->tick_rate = TICK_RATE;
+	game->frame_rate = -1;
+	game->pacer.show_stats = SDL_FALSE;
+	game->starfield.is_enabled = SDL_FALSE;
+	game->dirty.is_enabled = SDL_FALSE;
+	game->atlas.budget = TEXTURE_BUDGET;
+	game->atlas.steps = 1;
+	game->resolution.lowest_scale = 0;
+	game->score.visible_high = 0;
+	game->score.high = 0;
+	game->qcount = 0;
+	game->alien_count = ALIEN_POPULATION;
+	game->bigblue_hit_time = 0;
+	game->players = 1;
+
+	for (int i = 0; i < PLAYERS; i++) {
+		game->player[i].key = NO_KEY;
+		game->player[i].launcher = 0;
+		game->player[i].steer_x = WIDTH / 2;
+	}
+
+	game->replay.file = NULL;
+	game->replay.path = NULL;
+	game->replay.is_playing = SDL_FALSE;
+	game->net.is_active = game->net.is_host = SDL_FALSE;
+	game->net.address = NULL;
+	game->net.latency = game->net.loss = 0;
+	seed_random(game, 1);
+	game->aliens.capacity = game->aliens.count = 0;
+	game->projectiles.capacity = 0;
+	game->scheduler.worker_count = 1;
+	game->scheduler.work_ready = NULL;
+#ifdef SHIPXB11_PROFILE
+	init_profiler(game);
+#endif
+	reset_game(game);
+}
+
+/*
+	Splitmix64 spreads the seed over the state, which xorshift64* needs to be
+	non-zero. Unlike rand(), the numbers are the same on every platform, so
+	a recorded seed replays the same game.
+*/
+void seed_random(Game *game, Uint64 seed)
+{
+	Uint64 z = seed + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	game->random_state = (z ^ (z >> 31)) | 1;
+}
+
+// xorshift64*, the top half of the product, whose low bits are as good as its high ones.
+static Uint32 next_random(Game *game)
+{
+	Uint64 x = game->random_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	game->random_state = x;
+	return (x * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+// xorshift32, for random numbers kept apart from the simulation's, such as the simulator's input.
+Uint32 xorshift32(Uint32 *state)
+{
+	Uint32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// calloc() that exits, naming the caller, when it fails. The memory is zeroed.
+void *allocate(Game *game, size_t size, const char *caller)
+{
+	void *memory = calloc(1, size);
+
+	if (memory == NULL) {
+		fprintf(stderr, "%s: calloc returned NULL in function %s\n", game->title, caller);
+		exit(1);
+	}
+
+	return memory;
+}
+
+static void *alloc_entity_array(Game *game, int capacity, size_t size)
+{
+	void *array = calloc(capacity, size);
+
+	if (array == NULL) {
+		fprintf(stderr, "%s: calloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+
+	return array;
+}
+
+void init_entity_store(Game *game, EntityStore *store, int capacity)
+{
+	store->capacity = capacity;
+	store->count = 0;
+	store->x = alloc_entity_array(game, capacity, sizeof(double));
+	store->y = alloc_entity_array(game, capacity, sizeof(double));
+	store->dx = alloc_entity_array(game, capacity, sizeof(double));
+	store->dy = alloc_entity_array(game, capacity, sizeof(double));
+	store->width = alloc_entity_array(game, capacity, sizeof(int));
+	store->height = alloc_entity_array(game, capacity, sizeof(int));
+	store->flags = alloc_entity_array(game, capacity, sizeof(Uint8));
+	store->prev_x = alloc_entity_array(game, capacity, sizeof(double));
+	store->prev_y = alloc_entity_array(game, capacity, sizeof(double));
+	store->animation = alloc_entity_array(game, capacity, sizeof(EntityAnimation));
+	store->hit_mask = alloc_entity_array(game, (capacity + 63) / 64, sizeof(Uint64));
+	store->random = alloc_entity_array(game, 2 * capacity, sizeof(Uint32));
+}
+
+void free_entity_store(EntityStore *store)
+{
+	if (store->capacity == 0) {
+		return;
+	}
+
+	free(store->x);
+	free(store->y);
+	free(store->dx);
+	free(store->dy);
+	free(store->width);
+	free(store->height);
+	free(store->flags);
+	free(store->prev_x);
+	free(store->prev_y);
+	free(store->animation);
+	free(store->hit_mask);
+	free(store->random);
+	store->capacity = store->count = 0;
+}
+
+static SDL_bool boxes_intersect(double x1, double y1, int w1, int h1, double x2, double y2, int w2, int h2)
+{
+	return !(x2 > (x1 + w1) || (x2 + w2) < x1 || y2 > (y1 + h1) || (y2 + h2) < y1);
+}
+
+static SDL_bool has_intersection(Sprite *s1, Sprite *s2)
+{
+	return boxes_intersect(s1->x, s1->y, s1->width, s1->height, s2->x, s2->y, s2->width, s2->height);
+}
+
+// Index of the first bit set in a collide_boxes() mask at or after k, or count if there is none.
+static int next_hit(Uint64 *mask, int k, int count)
+{
+	while (k < count) {
+		Uint64 bits = mask[k >> 6] >> (k & 63);
+
+		if (bits == 0) {
+			k = (k | 63) + 1;
+			continue;
+		}
+
+		while (!(bits & 1)) {
+			bits >>= 1;
+			k++;
+		}
+
+		return k;
+	}
+
+	return count;
+}
+
+static void advance_frame(int *current_frame, int *next_frame_time, int frame_count, int frame_delay)
+{
+	if (*next_frame_time != 0) {
+		(*next_frame_time)--;
+		return;
+	}
+
+	*next_frame_time = frame_delay;
+
+	if (*current_frame < frame_count) {
+		(*current_frame)++;
+	} else {
+		*current_frame = 0;
+	}
+}
+
+void animate_sprite(Sprite *sprite)
+{
+	if (sprite->is_animated) {
+		advance_frame(&sprite->current_frame, &sprite->next_frame_time, sprite->frame_count, sprite->frame_delay);
+	}
+}
+
+static void animate_visible_sprite(Sprite *sprite)
+{
+	if (sprite->is_visible) {
+		animate_sprite(sprite);
+	}
+}
+
+static void save_sprite_position(Sprite *sprite)
+{
+	sprite->prev_x = sprite->x;
+	sprite->prev_y = sprite->y;
+}
+
+static void scroll_background(Game *game)
+{
+	game->background.y++;
+
+	if (game->background.y == game->height) {
+		game->background.y = 0;
+	}
+}
+
+void init_craft(Craft *craft)
+{
+	craft->is_exploding = SDL_FALSE;
+}
+
+static void reset_players(Game *game)
+{
+	for (int i = 0; i < game->players; i++) {
+		game->player[i].fire_delay = 0;
+		game->player[i].craft.sprite.is_visible = SDL_TRUE;
+	}
+}
+
+// Spread the ships out along the bottom, the others copying the first's frames. Call after init_sprites().
+void set_players(Game *game, int players)
+{
+	game->players = players;
+
+	for (int i = 0; i < players; i++) {
+		Player *player = &game->player[i];
+		player->craft = game->player[0].craft;
+		player->steer_x = game->width * (i + 1) / (players + 1);
+		player->craft.sprite.x = player->craft.sprite.prev_x = player->steer_x - player->craft.sprite.width / 2;
+	}
+
+	reset_players(game);
+}
+
+static void kill_asteroid(Game *game)
+{
+	game->asteroid.sprite.is_visible = SDL_FALSE;
+	game->asteroid.is_exploding = SDL_FALSE;
+
+	for (int i = 0; i < QUARTERS; i++) {
+		game->quarter[i].sprite.is_visible = SDL_FALSE;
+	}
+}
+
+void reset_bigblue(Game *game)
+{
+	init_craft(&game->bigblue);
+	game->bigblue.sprite.is_visible = SDL_FALSE;
+	game->bigblue.sprite.x = game->width;
+	game->bigblue.sprite.y = game->height / 2;
+	game->bigblue.sprite.dx = -2;
+	game->bigblue.sprite.frame_delay = 3;
+}
+
+void reset_aliens(Game *game)
+{
+	EntityStore *aliens = &game->aliens;
+	int leader_x = 5;
+	int leader_y = 20;
+	int line = 0;
+
+	// The store is sized by init_sprites(), before then there is nothing to place.
+	if (aliens->capacity == 0) {
+		return;
+	}
+
+	aliens->count = game->alien_type * game->alien_count;
+
+	for (int i = 0; i < game->alien_type; i++) {
+		int first = i * game->alien_count;
+		// Large populations wrap onto further lines.
+		int columns = SDL_max(1, (game->width - leader_x) / (aliens->width[first] + 20));
+
+		for (int j = 0; j < game->alien_count; j++) {
+			int k = first + j;
+			aliens->flags[k] = ENTITY_VISIBLE;
+			aliens->dx[k] = ((i & 1) << 2) - 2;
+			aliens->dy[k] = 0.1;
+			aliens->x[k] = leader_x + (j % columns) * (aliens->width[k] + 20.0);
+			aliens->y[k] = leader_y + (line + j / columns + 1) * (aliens->height[k] + 20.0);
+		}
+
+		line += (game->alien_count + columns - 1) / columns;
+	}
+}
+
+static void reset_asteroid(Game *game)
+{
+	int x[2] = { game->width, -game->asteroid.sprite.width };
+	int rand_zero_one = next_random(game) & 1;
+	init_craft(&game->asteroid);
+	game->asteroid.sprite.x = x[rand_zero_one];
+	game->asteroid.sprite.y = LINE_Y + (next_random(game) & 128);
+	game->asteroid.sprite.dx = (rand_zero_one << 1) - 1;
+	game->asteroid.sprite.dy = 1;
+	game->asteroid.sprite.is_visible = SDL_TRUE;
+}
+
+static void reset_asteroid_quarters(Game *game)
+{
+	double dx[QUARTERS] = { -0.25, 0.25, -0.25, 0.25 };
+	double dy[QUARTERS] = { -1, -1, 1, 1 };
+	int x = game->asteroid.sprite.x;
+	int y = game->asteroid.sprite.y;
+
+	for (int i = 0; i < QUARTERS; i++) {
+		Sprite *sprite = &game->quarter[i].sprite;
+		init_craft(&game->quarter[i]);
+		sprite->x = x + (i & 1) * (game->asteroid.sprite.width / 2);
+		sprite->y = y + (i >> 1) * (game->asteroid.sprite.height / 2);
+		sprite->dx = dx[i];
+		sprite->dy = dy[i];
+		sprite->is_visible = SDL_TRUE;
+	}
+
+	game->qcount = QUARTERS;
+}
+
+static void stop_animation(Sprite *sprite)
+{
+	sprite->is_animated = SDL_FALSE;
+	sprite->current_frame = 0;
+	sprite->next_frame_time = 0;
+}
+
+// Each explosion gets its own voice, panned to where it happened.
+static void play_explosion(Game *game, double x, int width)
+{
+	play_sound(game, SOUND_EXPLODE, 1.0, (x + width / 2.0) * 2.0 / game->width - 1.0);
+}
+
+// Every exploding craft shares the one explosion animation. Returns SDL_TRUE when it has finished.
+static SDL_bool advance_explosion(Game *game, SDL_bool is_visible)
+{
+	game->explosion.is_visible = SDL_TRUE;
+
+	if (is_visible) {
+		animate_sprite(&game->explosion);
+
+		if (game->explosion.current_frame == game->explosion.frame_count) {
+			game->explosion.current_frame = 0;
+			return SDL_TRUE;
+		}
+	}
+
+	return SDL_FALSE;
+}
+
+static SDL_bool is_player(Game *game, Craft *craft)
+{
+	for (int i = 0; i < game->players; i++) {
+		if (craft == &game->player[i].craft) {
+			return SDL_TRUE;
+		}
+	}
+
+	return SDL_FALSE;
+}
+
+// The players share their lives.
+static void update_explosion(Game *game, Craft *craft)
+{
+	if (!craft->is_exploding || !advance_explosion(game, craft->sprite.is_visible)) {
+		return;
+	}
+
+	craft->is_exploding = SDL_FALSE;
+
+	if (is_player(game, craft) && game->lives > 0) {
+		game->lives--;
+	} else {
+		craft->sprite.is_visible = SDL_FALSE;
+	}
+}
+
+static void update_alien_explosion(Game *game, EntityStore *aliens, int k)
+{
+	if (!(aliens->flags[k] & ENTITY_EXPLODING)) {
+		return;
+	}
+
+	if (advance_explosion(game, (aliens->flags[k] & ENTITY_VISIBLE) != 0)) {
+		aliens->flags[k] &= ~(ENTITY_EXPLODING | ENTITY_VISIBLE);
+	}
+}
+
+static void launch_missile(Game *game, Player *player)
+{
+	int launcher_x[4] = { 3, 9, 22, 28 };
+
+	if (player->fire_delay > 0) {
+		return;
+	}
+
+	if (spawn_projectile(&game->projectiles, OWNER_PLAYER, player->craft.sprite.x + launcher_x[player->launcher], player->craft.sprite.y, 0, -5) != NULL) {
+		player->fire_delay = PLAYER_FIRE_DELAY;
+		player->launcher = (player->launcher + 1) & 3;
+	}
+}
+
+Sprite *projectile_sprite(Game *game, Projectile *projectile)
+{
+	return projectile->owner == OWNER_PLAYER ? &game->playmis : &game->missile;
+}
+
+static void count_up_scores(Game *game)
+{
+	int i = 6;
+
+	if (game->score.visible_score < game->score.score) {
+		while (i >= 0) {
+			game->score.score_digit[i]++;
+
+			if (game->score.score_digit[i] > 9) {
+				game->score.score_digit[i] = 0;
+				i--;
+			} else {
+				break;
+			}
+		}
+
+		game->score.visible_score++;
+	}
+
+	if (game->score.visible_high < game->score.high) {
+		i = 6;
+
+		while (i >= 0) {
+			game->score.high_digit[i]++;
+
+			if (game->score.high_digit[i] > 9) {
+				game->score.high_digit[i] = 0;
+				i--;
+			} else
+				break;
+		}
+
+		game->score.visible_high++;
+	}
+
+	if (game->score.score > game->score.high) {
+		game->score.high = game->score.score;
+	}
+}
+
+// Big Blue fires a fan of missiles from its middle.
+static void fire_bigblue_spread(Game *game)
+{
+	if ((next_random(game) & 1023) >= game->level || !game->bigblue.sprite.is_visible) {
+		return;
+	}
+
+	double x = game->bigblue.sprite.x + game->bigblue.sprite.width / 2 - game->missile.width / 2;
+	double y = game->bigblue.sprite.y + game->bigblue.sprite.height;
+
+	for (int i = 0; i < BIGBLUE_SPREAD; i++) {
+		spawn_projectile(&game->projectiles, OWNER_BIGBLUE, x, y, (i - BIGBLUE_SPREAD / 2) * 0.5, 2);
+	}
+}
+
+static void move_bigblue(Game *game)
+{
+	if (game->bigblue.sprite.is_animated) {
+		game->bigblue_hit_time++;
+
+		if (game->bigblue_hit_time == 500) {
+			stop_animation(&game->bigblue.sprite);
+			game->bigblue_hit_time = 0;
+		}
+	} else {
+		game->bigblue_hit_time = 0;
+	}
+
+	game->bigblue.sprite.x += game->bigblue.sprite.dx;
+
+	if (game->bigblue.sprite.x < -game->bigblue.sprite.width) {
+		game->bigblue.sprite.x = game->width;
+	}
+}
+
+static void level_up(Game *game)
+{
+	game->level++;
+
+	if (game->alien_type < ALIEN_TYPE) {
+		game->alien_type++;
+	}
+
+	if (game->lives < 6) {
+		game->lives++;
+	}
+
+	reset_aliens(game);
+}
+
+// Set a bit in mask for each visible alien the box overlaps.
+static void find_alien_hits(Game *game, double x, double y, int width, int height, Uint64 *mask)
+{
+	EntityStore *aliens = &game->aliens;
+
+	if (game->alien_grid.is_built) {
+		query_grid(&game->alien_grid, aliens, x, y, width, height, mask);
+	} else {
+		collide_boxes(aliens, x, y, width, height, mask);
+	}
+}
+
+// Boxes to test against the aliens this tick.
+static int count_alien_queries(Game *game)
+{
+	int queries = game->projectiles.owned[OWNER_PLAYER];
+
+	for (int i = 0; i < QUARTERS; i++) {
+		queries += game->quarter[i].sprite.is_visible;
+	}
+
+	return queries;
+}
+
+// Only the first alien hit, in store order, takes a missile. Hits only read the aliens, so the missiles can look in parallel.
+static void find_player_missile_hits(Game *game, void *data, int chunk, int start, int end, int worker)
+{
+	EntityStore *aliens = &game->aliens;
+	ProjectilePool *pool = &game->projectiles;
+	Uint64 *mask = worker_hit_mask(game, worker);
+
+	for (int i = start; i < end; i++) {
+		Projectile *projectile = &pool->projectile[i];
+		pool->hit[i] = -1;
+
+		if (projectile->life == 0 || projectile->owner != OWNER_PLAYER) {
+			continue;
+		}
+
+		find_alien_hits(game, projectile->x, projectile->y, game->playmis.width, game->playmis.height, mask);
+
+		for (int k = next_hit(mask, 0, aliens->count); k < aliens->count; k = next_hit(mask, k + 1, aliens->count)) {
+			if (aliens->flags[k] & ENTITY_VISIBLE) {
+				pool->hit[i] = k;
+				break;
+			}
+		}
+	}
+}
+
+// Two missiles can hit the same alien, so the hits are scored in slot order, as one at a time would.
+static void check_if_player_missiles_hit_aliens(Game *game, EntityStore *aliens)
+{
+	ProjectilePool *pool = &game->projectiles;
+
+	if (pool->owned[OWNER_PLAYER] == 0) {
+		return;
+	}
+
+	parallel_for(game, pool->end, find_player_missile_hits, NULL);
+
+	for (int i = 0; i < pool->end; i++) {
+		int k = pool->hit[i];
+
+		if (k < 0) {
+			continue;
+		}
+
+		if (!(aliens->flags[k] & ENTITY_EXPLODING)) {
+			play_explosion(game, aliens->x[k], aliens->width[k]);
+		}
+
+		aliens->flags[k] |= ENTITY_EXPLODING;
+		remove_projectile(pool, &pool->projectile[i]);
+		game->score.score += 20;
+	}
+}
+
+static void check_if_quarters_hit_aliens(Game *game, EntityStore *aliens)
+{
+	for (int i = 0; i < QUARTERS; i++) {
+		Sprite *quarter = &game->quarter[i].sprite;
+
+		if (!quarter->is_visible) {
+			continue;
+		}
+
+		find_alien_hits(game, quarter->x, quarter->y, quarter->width, quarter->height, aliens->hit_mask);
+
+		for (int k = next_hit(aliens->hit_mask, 0, aliens->count); k < aliens->count; k = next_hit(aliens->hit_mask, k + 1, aliens->count)) {
+			if ((aliens->flags[k] & (ENTITY_VISIBLE | ENTITY_EXPLODING)) == ENTITY_VISIBLE) {
+				aliens->flags[k] |= ENTITY_EXPLODING;
+				play_explosion(game, aliens->x[k], aliens->width[k]);
+				game->score.score += 20;
+			}
+		}
+	}
+}
+
+// random holds the numbers drawn for the alien, one to turn it when the level is past ALIEN_TYPE, and one to fire.
+static void move_alien_ship(Game *game, EntityStore *aliens, int k, const Uint32 *random)
+{
+	aliens->x[k] += aliens->dx[k];
+	aliens->y[k] += aliens->dy[k];
+
+	if (aliens->x[k] > game->width - aliens->width[k] || aliens->x[k] < 0) {
+		aliens->dx[k] = -aliens->dx[k];
+	}
+
+	if (game->level <= ALIEN_TYPE) {
+		return;
+	}
+
+	if ((random[0] & 8191) > 8189) {
+		aliens->dy[k] = 1.0;
+	}
+
+	if (aliens->y[k] > 600 || aliens->y[k] < 72) {
+		aliens->dy[k] = -aliens->dy[k];
+	}
+}
+
+static void fire_alien_ship_missile(Game *game, EntityStore *aliens, int k)
+{
+	spawn_projectile(&game->projectiles, OWNER_ALIEN, aliens->x[k] + aliens->width[k] / 2, aliens->y[k] + aliens->height[k], 0, 2);
+}
+
+/*
+	Many aliens move in chunks on the workers. They take their random
+	numbers in store order, a turn then a shot for each, so the numbers are
+	drawn up front once each chunk has counted its aliens, and every chunk
+	knows where its own start. Their missiles go in the shared pool, so the
+	chunks only mark the aliens that fire, and the missiles are spawned
+	afterwards in store order.
+*/
+typedef struct {
+	int draws;
+	int alive[MAX_TASK_CHUNKS];
+	int first_random[MAX_TASK_CHUNKS];
+} AlienMove;
+
+static void count_alive_aliens(Game *game, void *data, int chunk, int start, int end, int worker)
+{
+	EntityStore *aliens = &game->aliens;
+	int alive = 0;
+
+	for (int k = start; k < end; k++) {
+		alive += (aliens->flags[k] & ENTITY_VISIBLE) != 0;
+	}
+
+	((AlienMove *)data)->alive[chunk] = alive;
+}
+
+static void move_alien_ships(Game *game, void *data, int chunk, int start, int end, int worker)
+{
+	AlienMove *move = data;
+	EntityStore *aliens = &game->aliens;
+	const Uint32 *random = &aliens->random[move->first_random[chunk]];
+
+	for (int k = start; k < end; k++) {
+		if (aliens->flags[k] & ENTITY_VISIBLE) {
+			move_alien_ship(game, aliens, k, random);
+
+			if ((random[move->draws - 1] & 1023) < game->level) {
+				aliens->flags[k] |= ENTITY_FIRING;
+			}
+
+			random += move->draws;
+		}
+	}
+}
+
+static int move_aliens_in_chunks(Game *game, EntityStore *aliens, int draws)
+{
+	int chunks = task_chunks(game, aliens->count);
+	int aliens_alive = 0;
+	AlienMove move;
+
+	move.draws = draws;
+	parallel_for(game, aliens->count, count_alive_aliens, &move);
+
+	for (int c = 0; c < chunks; c++) {
+		move.first_random[c] = aliens_alive * draws;
+		aliens_alive += move.alive[c];
+	}
+
+	for (int i = 0; i < aliens_alive * draws; i++) {
+		aliens->random[i] = next_random(game);
+	}
+
+	parallel_for(game, aliens->count, move_alien_ships, &move);
+
+	for (int k = 0; k < aliens->count; k++) {
+		if (aliens->flags[k] & ENTITY_FIRING) {
+			aliens->flags[k] &= ~ENTITY_FIRING;
+			fire_alien_ship_missile(game, aliens, k);
+		}
+	}
+
+	return aliens_alive;
+}
+
+static void move_aliens(Game *game)
+{
+	EntityStore *aliens = &game->aliens;
+	int draws = game->level > ALIEN_TYPE ? 2 : 1;
+	int aliens_alive = 0;
+
+	// Nothing else moves until every alien has been checked, so the hits can be found in bulk.
+	// A rebuild costs several vector scans of the store, so the grid only pays for many queries.
+	game->alien_grid.is_built = SDL_FALSE;
+
+	if (count_alien_queries(game) >= GRID_MIN_QUERIES) {
+		build_grid(game, &game->alien_grid, aliens);
+	}
+
+	check_if_player_missiles_hit_aliens(game, aliens);
+	check_if_quarters_hit_aliens(game, aliens);
+
+	if (task_chunks(game, aliens->count) > 1) {
+		aliens_alive = move_aliens_in_chunks(game, aliens, draws);
+	} else {
+		for (int k = 0; k < aliens->count; k++) {
+			if (aliens->flags[k] & ENTITY_VISIBLE) {
+				Uint32 random[2];
+				aliens_alive++;
+
+				for (int i = 0; i < draws; i++) {
+					random[i] = next_random(game);
+				}
+
+				move_alien_ship(game, aliens, k, random);
+
+				if ((random[draws - 1] & 1023) < game->level) {
+					fire_alien_ship_missile(game, aliens, k);
+				}
+			}
+		}
+	}
+
+	if (aliens_alive == 0) {
+		level_up(game);
+	}
+}
+
+static void move_player(Game *game, Player *player)
+{
+	Sprite *sprite = &player->craft.sprite;
+	unsigned int direction = player->key & (LEFT_KEY | RIGHT_KEY);
+
+	if (direction == LEFT_KEY && player->steer_x >= sprite->x) {
+		player->steer_x -= 2;
+	} else if (direction == RIGHT_KEY && player->steer_x <= sprite->x) {
+		player->steer_x += 2;
+	}
+
+	if (sprite->x > player->steer_x) {
+		if (sprite->x > 0) {
+			sprite->x--;
+		}
+	} else if (sprite->x < player->steer_x) {
+		if (sprite->x < game->width - sprite->width) {
+			sprite->x++;
+		}
+	}
+
+	// A tap fires even if the key was let go before this tick.
+	if (player->key & TAP_KEY) {
+		launch_missile(game, player);
+		player->key &= ~TAP_KEY;
+	}
+
+	if (player->fire_delay > 0) {
+		player->fire_delay--;
+	}
+
+	// Holding fire keeps firing as fast as the fire delay allows.
+	if (player->key & FIRE_KEY) {
+		launch_missile(game, player);
+	}
+}
+
+// The first hit wakes Big Blue up, a second before it settles again destroys it.
+static void hit_bigblue(Game *game)
+{
+	if (game->bigblue.sprite.is_animated) {
+		stop_animation(&game->bigblue.sprite);
+		game->bigblue.is_exploding = SDL_TRUE;
+		play_explosion(game, game->bigblue.sprite.x, game->bigblue.sprite.width);
+		game->score.score += 100;
+	} else {
+		game->bigblue.sprite.is_animated = SDL_TRUE;
+	}
+}
+
+static void check_if_quarters_hit_bigblue(Game *game)
+{
+	if (!game->bigblue.sprite.is_visible) {
+		return;
+	}
+
+	for (int i = 0; i < QUARTERS; i++) {
+		if (has_intersection(&game->bigblue.sprite, &game->quarter[i].sprite)) {
+			hit_bigblue(game);
+		}
+	}
+}
+
+static SDL_bool projectile_hits(Game *game, Projectile *projectile, Sprite *target)
+{
+	Sprite *sprite = projectile_sprite(game, projectile);
+	return boxes_intersect(target->x, target->y, target->width, target->height, projectile->x, projectile->y, sprite->width, sprite->height);
+}
+
+static SDL_bool check_if_player_missile_hit_bigblue(Game *game, Projectile *projectile)
+{
+	if (!game->bigblue.sprite.is_visible || !projectile_hits(game, projectile, &game->bigblue.sprite)) {
+		return SDL_FALSE;
+	}
+
+	hit_bigblue(game);
+	return SDL_TRUE;
+}
+
+static SDL_bool check_if_player_missile_hit_asteroid(Game *game, Projectile *projectile)
+{
+	if (!game->asteroid.sprite.is_visible || !projectile_hits(game, projectile, &game->asteroid.sprite)) {
+		return SDL_FALSE;
+	}
+
+	game->score.score += 20;
+	reset_asteroid_quarters(game);
+	game->asteroid.is_exploding = SDL_TRUE;
+	play_explosion(game, game->asteroid.sprite.x, game->asteroid.sprite.width);
+	return SDL_TRUE;
+}
+
+// A missile only takes one player, the first it hits.
+static SDL_bool check_if_missile_hit_player(Game *game, Projectile *projectile)
+{
+	for (int i = 0; i < game->players; i++) {
+		Craft *craft = &game->player[i].craft;
+
+		if (!projectile_hits(game, projectile, &craft->sprite)) {
+			continue;
+		}
+
+		if (!craft->is_exploding) {
+			play_explosion(game, craft->sprite.x, craft->sprite.width);
+		}
+
+		craft->is_exploding = SDL_TRUE;
+		return SDL_TRUE;
+	}
+
+	return SDL_FALSE;
+}
+
+static SDL_bool is_projectile_spent(Game *game, Projectile *projectile)
+{
+	if (projectile->life == 0) {
+		return SDL_TRUE;
+	}
+
+	if (projectile->owner == OWNER_PLAYER) {
+		return projectile->y < LINE_Y || check_if_player_missile_hit_bigblue(game, projectile) || check_if_player_missile_hit_asteroid(game, projectile);
+	}
+
+	return projectile->y > game->height || projectile->x < -game->missile.width || projectile->x > game->width || check_if_missile_hit_player(game, projectile);
+}
+
+// Whether is_projectile_spent() could say yes, from tests that change nothing, whatever can be hit.
+static SDL_bool may_be_spent(Game *game, Projectile *projectile)
+{
+	if (projectile->life == 0) {
+		return SDL_TRUE;
+	}
+
+	if (projectile->owner == OWNER_PLAYER) {
+		return projectile->y < LINE_Y || projectile_hits(game, projectile, &game->bigblue.sprite) || projectile_hits(game, projectile, &game->asteroid.sprite);
+	}
+
+	if (projectile->y > game->height || projectile->x < -game->missile.width || projectile->x > game->width) {
+		return SDL_TRUE;
+	}
+
+	for (int i = 0; i < game->players; i++) {
+		if (projectile_hits(game, projectile, &game->player[i].craft.sprite)) {
+			return SDL_TRUE;
+		}
+	}
+
+	return SDL_FALSE;
+}
+
+static void move_projectile_range(Game *game, void *data, int chunk, int start, int end, int worker)
+{
+	ProjectilePool *pool = &game->projectiles;
+
+	for (int i = start; i < end; i++) {
+		Projectile *projectile = &pool->projectile[i];
+		pool->hit[i] = 0;
+
+		if (projectile->life == 0) {
+			continue;
+		}
+
+		projectile->prev_x = projectile->x;
+		projectile->prev_y = projectile->y;
+		projectile->x += projectile->dx;
+		projectile->y += projectile->dy;
+		projectile->life--;
+		pool->hit[i] = may_be_spent(game, projectile);
+	}
+}
+
+/*
+	Move and age every projectile on the workers, then cull the few that
+	may be spent, in slot order, since a hit changes what it hit. Player
+	missiles meet the aliens later, in move_aliens().
+*/
+static void move_projectiles(Game *game)
+{
+	ProjectilePool *pool = &game->projectiles;
+
+	parallel_for(game, pool->end, move_projectile_range, NULL);
+
+	for (int i = 0; i < pool->end; i++) {
+		if (pool->hit[i] && is_projectile_spent(game, &pool->projectile[i])) {
+			remove_projectile(pool, &pool->projectile[i]);
+		}
+	}
+
+	trim_projectiles(pool);
+}
+
+static void move_asteroid(Game *game)
+{
+	if (!game->asteroid.sprite.is_visible) {
+		return;
+	}
+
+	game->asteroid.sprite.x += game->asteroid.sprite.dx;
+	game->asteroid.sprite.y += game->asteroid.sprite.dy;
+
+	if (game->asteroid.sprite.x > game->width || game->asteroid.sprite.y > game->height || game->asteroid.sprite.x < -game->asteroid.sprite.width) {
+		game->asteroid.sprite.is_visible = SDL_FALSE;
+	}
+}
+
+static void move_asteroid_quarters(Game *game)
+{
+	if (game->qcount == 0) {
+		return;
+	}
+
+	for (int i = 0; i < QUARTERS; i++) {
+		Sprite *sprite = &game->quarter[i].sprite;
+
+		if (!sprite->is_visible) {
+			continue;
+		}
+
+		sprite->x += sprite->dx;
+		sprite->y += sprite->dy;
+
+		// Each quarter flies away from the others, so only the edges it is heading for are checked.
+		SDL_bool is_off_x = sprite->dx < 0 ? sprite->x < -sprite->width : sprite->x > game->width;
+		SDL_bool is_off_y = sprite->dy < 0 ? sprite->y < -sprite->height : sprite->y > game->height;
+
+		if (is_off_x || is_off_y) {
+			game->qcount--;
+			sprite->is_visible = SDL_FALSE;
+		}
+	}
+
+	check_if_quarters_hit_bigblue(game);
+}
+
+static void move_graphics(Game *game)
+{
+	move_bigblue(game);
+	fire_bigblue_spread(game);
+	move_asteroid(game);
+	PROFILE_BEGIN(move_projectiles);
+	move_projectiles(game);
+	PROFILE_END(game, move_projectiles);
+	PROFILE_BEGIN(move_aliens);
+	move_aliens(game);
+	PROFILE_END(game, move_aliens);
+
+	for (int i = 0; i < game->players; i++) {
+		move_player(game, &game->player[i]);
+	}
+
+	move_asteroid_quarters(game);
+}
+
+static void save_positions(Game *game)
+{
+	EntityStore *aliens = &game->aliens;
+
+	for (int k = 0; k < aliens->count; k++) {
+		aliens->prev_x[k] = aliens->x[k];
+		aliens->prev_y[k] = aliens->y[k];
+	}
+
+	save_sprite_position(&game->background);
+	save_sprite_position(&game->bigblue.sprite);
+	save_sprite_position(&game->asteroid.sprite);
+
+	for (int i = 0; i < QUARTERS; i++) {
+		save_sprite_position(&game->quarter[i].sprite);
+	}
+
+	for (int i = 0; i < game->players; i++) {
+		save_sprite_position(&game->player[i].craft.sprite);
+	}
+}
+
+static void animate_sprites(Game *game)
+{
+	EntityStore *aliens = &game->aliens;
+
+	for (int k = 0; k < aliens->count; k++) {
+		if (aliens->flags[k] & ENTITY_VISIBLE) {
+			Sprite *sprite = &game->alien_sprite[aliens->animation[k].type];
+			advance_frame(&aliens->animation[k].current_frame, &aliens->animation[k].next_frame_time, sprite->frame_count, sprite->frame_delay);
+		}
+
+		update_alien_explosion(game, aliens, k);
+	}
+
+	animate_visible_sprite(&game->bigblue.sprite);
+	animate_visible_sprite(&game->asteroid.sprite);
+
+	for (int i = 0; i < QUARTERS; i++) {
+		animate_visible_sprite(&game->quarter[i].sprite);
+	}
+
+	update_explosion(game, &game->bigblue);
+	update_explosion(game, &game->asteroid);
+
+	for (int i = 0; i < game->players; i++) {
+		animate_visible_sprite(&game->player[i].craft.sprite);
+		update_explosion(game, &game->player[i].craft);
+	}
+
+	animate_sprite(&game->playmis);
+	animate_sprite(&game->missile);
+}
+
+static void do_irregular_actions(Game *game)
+{
+	// Bring on Big Blue alien at random.
+	if (!game->bigblue.sprite.is_visible) {
+		if ((next_random(game) & 8191) > 8189) {
+			reset_bigblue(game);
+			game->bigblue.sprite.is_visible = SDL_TRUE;
+		}
+	}
+
+	// Bring on asteroid at random.
+	if (!game->asteroid.sprite.is_visible && game->qcount == 0) {
+		if ((next_random(game) & 8191) > 8182) {
+			reset_asteroid(game);
+		}
+	}
+}
+
+// Advance the simulation by one fixed tick. All speeds are in pixels per tick.
+void update_game(Game *game)
+{
+	save_positions(game);
+	scroll_background(game);
+	animate_sprites(game);
+	count_up_scores(game);
+	PROFILE_BEGIN(do_irregular_actions);
+	do_irregular_actions(game);
+	PROFILE_END(game, do_irregular_actions);
+	PROFILE_BEGIN(move_graphics);
+	move_graphics(game);
+	PROFILE_END(game, move_graphics);
+}
+
+void reset_game(Game *game)
+{
+	for (int i = 0; i < 7; i++) {
+		game->score.score_digit[i] = 0;
+	}
+
+	game->level = 1;
+	game->lives = 3;
+	game->score.score = 0;
+	game->score.visible_score = 0;
+	game->alien_type = 1;
+	reset_aliens(game);
+	reset_bigblue(game);
+	reset_players(game);
+	kill_asteroid(game);
+	clear_projectiles(&game->projectiles);
+}
+
+static Uint64 hash_bytes(Uint64 hash, const void *data, size_t size)
+{
+	const Uint8 *byte = data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= byte[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static Uint64 hash_sprite(Uint64 hash, Sprite *sprite)
+{
+	hash = hash_bytes(hash, &sprite->is_visible, sizeof(sprite->is_visible));
+	hash = hash_bytes(hash, &sprite->is_animated, sizeof(sprite->is_animated));
+	hash = hash_bytes(hash, &sprite->x, sizeof(sprite->x));
+	hash = hash_bytes(hash, &sprite->y, sizeof(sprite->y));
+	hash = hash_bytes(hash, &sprite->dx, sizeof(sprite->dx));
+	hash = hash_bytes(hash, &sprite->dy, sizeof(sprite->dy));
+	hash = hash_bytes(hash, &sprite->current_frame, sizeof(sprite->current_frame));
+	return hash_bytes(hash, &sprite->next_frame_time, sizeof(sprite->next_frame_time));
+}
+
+static Uint64 hash_craft(Uint64 hash, Craft *craft)
+{
+	hash = hash_bytes(hash, &craft->is_exploding, sizeof(craft->is_exploding));
+	return hash_sprite(hash, &craft->sprite);
+}
+
+static Uint64 hash_alien(Uint64 hash, EntityStore *aliens, int k)
+{
+	hash = hash_bytes(hash, &aliens->flags[k], sizeof(aliens->flags[k]));
+	hash = hash_bytes(hash, &aliens->x[k], sizeof(aliens->x[k]));
+	hash = hash_bytes(hash, &aliens->y[k], sizeof(aliens->y[k]));
+	hash = hash_bytes(hash, &aliens->dx[k], sizeof(aliens->dx[k]));
+	hash = hash_bytes(hash, &aliens->dy[k], sizeof(aliens->dy[k]));
+	hash = hash_bytes(hash, &aliens->animation[k].current_frame, sizeof(aliens->animation[k].current_frame));
+	return hash_bytes(hash, &aliens->animation[k].next_frame_time, sizeof(aliens->animation[k].next_frame_time));
+}
+
+static Uint64 hash_projectile(Uint64 hash, Projectile *projectile)
+{
+	hash = hash_bytes(hash, &projectile->x, sizeof(projectile->x));
+	hash = hash_bytes(hash, &projectile->y, sizeof(projectile->y));
+	hash = hash_bytes(hash, &projectile->dx, sizeof(projectile->dx));
+	hash = hash_bytes(hash, &projectile->dy, sizeof(projectile->dy));
+	hash = hash_bytes(hash, &projectile->owner, sizeof(projectile->owner));
+	return hash_bytes(hash, &projectile->life, sizeof(projectile->life));
+}
+
+// FNV-1a hash of the simulation state, for checking that runs are deterministic.
+Uint64 hash_game_state(Game *game)
+{
+	Uint64 hash = 0xcbf29ce484222325ULL;
+
+	for (int k = 0; k < game->aliens.capacity; k++) {
+		hash = hash_alien(hash, &game->aliens, k);
+	}
+
+	hash = hash_craft(hash, &game->asteroid);
+	hash = hash_craft(hash, &game->bigblue);
+
+	for (int i = 0; i < game->players; i++) {
+		hash = hash_craft(hash, &game->player[i].craft);
+	}
+
+	for (int i = 0; i < QUARTERS; i++) {
+		hash = hash_craft(hash, &game->quarter[i]);
+	}
+
+	hash = hash_sprite(hash, &game->explosion);
+	hash = hash_sprite(hash, &game->missile);
+	hash = hash_sprite(hash, &game->playmis);
+
+	for (int i = 0; i < game->projectiles.end; i++) {
+		if (game->projectiles.projectile[i].life > 0) {
+			hash = hash_projectile(hash, &game->projectiles.projectile[i]);
+		}
+	}
+
+	hash = hash_bytes(hash, &game->random_state, sizeof(game->random_state));
+	hash = hash_bytes(hash, &game->bigblue_hit_time, sizeof(game->bigblue_hit_time));
+
+	for (int i = 0; i < game->players; i++) {
+		hash = hash_bytes(hash, &game->player[i].fire_delay, sizeof(game->player[i].fire_delay));
+		hash = hash_bytes(hash, &game->player[i].launcher, sizeof(game->player[i].launcher));
+		hash = hash_bytes(hash, &game->player[i].steer_x, sizeof(game->player[i].steer_x));
+	}
+
+	hash = hash_bytes(hash, &game->alien_type, sizeof(game->alien_type));
+	hash = hash_bytes(hash, &game->level, sizeof(game->level));
+	hash = hash_bytes(hash, &game->lives, sizeof(game->lives));
+	hash = hash_bytes(hash, &game->qcount, sizeof(game->qcount));
+	hash = hash_bytes(hash, &game->score.score, sizeof(game->score.score));
+	return hash_bytes(hash, &game->score.high, sizeof(game->score.high));
+}
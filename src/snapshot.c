@@ -0,0 +1,129 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Snapshots of the simulation, for rolling it back. The state lives among
+	textures, frames and other things the simulation never changes, so
+	init_snapshot() lists the blocks of memory it does change, and a snapshot
+	is those blocks one after another. Sprites keep their frame pointer last
+	and only the fields before it are copied, so a snapshot holds no
+	pointers, and saving or loading one is a memcpy() per block.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shipxb11.h"
+
+#define add_value(game, value) add_region(game, &(value), sizeof(value))
+
+static void add_region(Game *game, void *data, size_t size)
+{
+	SnapshotLayout *layout = &game->snapshot;
+
+	if (layout->region_count == MAX_SNAPSHOT_REGIONS) {
+		fprintf(stderr, "%s: MAX_SNAPSHOT_REGIONS is too small.\n", game->title);
+		exit(1);
+	}
+
+	layout->region[layout->region_count].data = data;
+	layout->region[layout->region_count].size = size;
+	layout->region_count++;
+	layout->size += size;
+}
+
+static void add_sprite(Game *game, Sprite *sprite)
+{
+	add_region(game, sprite, offsetof(Sprite, frame));
+}
+
+static void add_craft(Game *game, Craft *craft)
+{
+	add_region(game, craft, offsetof(Craft, sprite.frame));
+}
+
+// Call once the sprites are loaded and the players set, as it takes the addresses of the stores.
+void init_snapshot(Game *game)
+{
+	EntityStore *aliens = &game->aliens;
+	ProjectilePool *pool = &game->projectiles;
+
+	game->snapshot.region_count = 0;
+	game->snapshot.size = 0;
+	add_value(game, game->alien_type);
+	add_value(game, game->bigblue_hit_time);
+	add_value(game, game->level);
+	add_value(game, game->lives);
+	add_value(game, game->qcount);
+	add_value(game, game->random_state);
+	add_value(game, game->score);
+	add_sprite(game, &game->background);
+	add_sprite(game, &game->explosion);
+	add_sprite(game, &game->missile);
+	add_sprite(game, &game->playmis);
+	add_craft(game, &game->asteroid);
+	add_craft(game, &game->bigblue);
+
+	for (int i = 0; i < QUARTERS; i++) {
+		add_craft(game, &game->quarter[i]);
+	}
+
+	for (int i = 0; i < game->players; i++) {
+		add_region(game, &game->player[i], offsetof(Player, craft.sprite.frame));
+	}
+
+	// The aliens' sizes are set when their sprites load and never change.
+	add_value(game, aliens->count);
+	add_region(game, aliens->x, aliens->capacity * sizeof(*aliens->x));
+	add_region(game, aliens->y, aliens->capacity * sizeof(*aliens->y));
+	add_region(game, aliens->dx, aliens->capacity * sizeof(*aliens->dx));
+	add_region(game, aliens->dy, aliens->capacity * sizeof(*aliens->dy));
+	add_region(game, aliens->flags, aliens->capacity * sizeof(*aliens->flags));
+	add_region(game, aliens->prev_x, aliens->capacity * sizeof(*aliens->prev_x));
+	add_region(game, aliens->prev_y, aliens->capacity * sizeof(*aliens->prev_y));
+	add_region(game, aliens->animation, aliens->capacity * sizeof(*aliens->animation));
+
+	// The whole pool, as the free list runs through the slots above end too.
+	add_region(game, pool, offsetof(ProjectilePool, projectile));
+	add_region(game, pool->projectile, pool->capacity * sizeof(*pool->projectile));
+}
+
+// buffer must hold game->snapshot.size bytes.
+void save_snapshot(Game *game, Uint8 *buffer)
+{
+	SnapshotLayout *layout = &game->snapshot;
+
+	for (int i = 0; i < layout->region_count; i++) {
+		memcpy(buffer, layout->region[i].data, layout->region[i].size);
+		buffer += layout->region[i].size;
+	}
+}
+
+void load_snapshot(Game *game, const Uint8 *buffer)
+{
+	SnapshotLayout *layout = &game->snapshot;
+
+	for (int i = 0; i < layout->region_count; i++) {
+		memcpy(layout->region[i].data, buffer, layout->region[i].size);
+		buffer += layout->region[i].size;
+	}
+
+	// The grid was built from positions the snapshot has replaced.
+	game->alien_grid.is_built = SDL_FALSE;
+}
@@ -0,0 +1,748 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <SDL2/SDL2_rotozoom.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "shipxb11.h"
+
+// Percent of full size the scene is drawn at on each resolution step.
+static const int resolution_scales[RESOLUTION_STEPS] = { 100, 85, 70, 50 };
+
+int resolution_scale(int step)
+{
+	return resolution_scales[step];
+}
+
+// Scale the edges rather than the size, so rectangles that meet still meet once scaled.
+void scale_rect(const SDL_Rect *rect, int step, SDL_Rect *scaled)
+{
+	int scale = resolution_scales[step];
+	int x = (rect->x * scale + 50) / 100;
+	int y = (rect->y * scale + 50) / 100;
+	int width = ((rect->x + rect->w) * scale + 50) / 100 - x;
+	int height = ((rect->y + rect->h) * scale + 50) / 100 - y;
+	set_rect((*scaled), x, y, SDL_max(1, width), SDL_max(1, height));
+}
+
+static void add_atlas_entry(Game *game, SDL_Surface *surface, Frame *frame)
+{
+	game->atlas.entry = realloc(game->atlas.entry, sizeof(AtlasEntry) * (game->atlas.entry_count + 1));
+
+	if (game->atlas.entry == NULL) {
+		fprintf(stderr, "%s: realloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+
+	game->atlas.entry[game->atlas.entry_count].surface = surface;
+	game->atlas.entry[game->atlas.entry_count].frame = frame;
+	game->atlas.entry_count++;
+}
+
+// Alien types after the first are only needed from later levels, so they are kept apart.
+static int image_group(int image)
+{
+	return image > IMAGE_PURPLE && image < IMAGE_PURPLE + ALIEN_TYPE ? image - IMAGE_PURPLE : 0;
+}
+
+// Wrap the frames in surfaces over the pack's pixels, which stays open until the group is built.
+static int add_pack_frames(Game *game, Sprite *sprite, PackSprite *pack_sprite)
+{
+	for (Uint32 i = 0; i < pack_sprite->frame_count; i++) {
+		PackImage *image = &game->pack.image[pack_sprite->first_image + i];
+		void *pixels = (Uint8 *)game->pack.data + image->offset;
+		SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels, image->width, image->height, 32, image->pitch, image->format);
+
+		if (surface == NULL) {
+			fprintf(stderr, "%s: %s\n", game->title, SDL_GetError());
+			return 1;
+		}
+
+		add_atlas_entry(game, surface, &sprite->frame[i]);
+	}
+
+	return 0;
+}
+
+// The atlas takes over the decoded frames, so building the group again means decoding them again.
+static int add_decoded_frames(Game *game, Sprite *sprite, int image)
+{
+	prefetch_job(game, image);
+	LoadJob *job = wait_for_job(game, image);
+
+	if (job->frame_count != sprite->frame_count + 1) {
+		fprintf(stderr, "%s: %s has changed since it was first loaded.\n", game->title, job->path);
+		return 1;
+	}
+
+	for (int i = 0; i < job->frame_count; i++) {
+		add_atlas_entry(game, job->frame[i], &sprite->frame[i]);
+	}
+
+	free(job->frame);
+	job->frame = NULL;
+	job->frame_count = 0;
+	return 0;
+}
+
+// Only the size and frame count are read here. The frames go into the atlas when the sprite's group is built.
+static int load_sprite(Game *game, Sprite *sprite, int image)
+{
+	LoadJob *job = wait_for_job(game, image);
+	int frame_count;
+
+	if (job->pack_sprite != NULL) {
+		PackImage *first = &game->pack.image[job->pack_sprite->first_image];
+		frame_count = job->pack_sprite->frame_count;
+		sprite->width = first->width;
+		sprite->height = first->height;
+	} else if (job->frame_count > 0) {
+		frame_count = job->frame_count;
+		sprite->width = job->frame[0]->w;
+		sprite->height = job->frame[0]->h;
+	} else {
+		return 1;
+	}
+
+	sprite->frame = (Frame *)malloc(sizeof(Frame) * frame_count);
+
+	if (sprite->frame == NULL) {
+		fprintf(stderr, "%s: malloc returned NULL in function %s\n", game->title, __func__);
+		exit(1);
+	}
+
+	sprite->frame_count = frame_count - 1;
+	game->atlas.sprite[image] = sprite;
+	return 0;
+}
+
+static int compare_atlas_entries(const void *p1, const void *p2)
+{
+	const AtlasEntry *e1 = p1;
+	const AtlasEntry *e2 = p2;
+
+	if (e1->surface->h != e2->surface->h) {
+		return e2->surface->h - e1->surface->h;
+	}
+
+	return e2->surface->w - e1->surface->w;
+}
+
+static SDL_bool is_opaque(SDL_Surface *surface)
+{
+	return surface->format->Amask == 0 && surface->format->palette == NULL;
+}
+
+// Shelf pack the entries with the given opacity into pages, starting at page first_page.
+static int place_atlas_entries(Game *game, SDL_bool opaque, int first_page, int size, int *page_width, int *page_height)
+{
+	int page = first_page;
+	int x = 0, y = 0, shelf = 0;
+	SDL_bool used = SDL_FALSE;
+
+	for (int i = 0; i < game->atlas.entry_count; i++) {
+		SDL_Surface *surface = game->atlas.entry[i].surface;
+
+		if (is_opaque(surface) != opaque) {
+			continue;
+		}
+
+		if (surface->w > size || surface->h > size) {
+			fprintf(stderr, "%s: %d x %d image is too big for the %d x %d atlas.\n", game->title, surface->w, surface->h, size, size);
+			return -1;
+		}
+
+		if (x + surface->w > size) {
+			x = 0;
+			y += shelf + ATLAS_PADDING;
+			shelf = 0;
+		}
+
+		if (y + surface->h > size) {
+			page++;
+			x = y = shelf = 0;
+		}
+
+		if (page >= MAX_ATLAS_PAGES) {
+			fprintf(stderr, "%s: Too many atlas pages.\n", game->title);
+			return -1;
+		}
+
+		set_rect(game->atlas.entry[i].frame->rect, x, y, surface->w, surface->h);
+		game->atlas.entry[i].frame->page = page;
+		x += surface->w + ATLAS_PADDING;
+
+		if (x - ATLAS_PADDING > page_width[page]) {
+			page_width[page] = x - ATLAS_PADDING;
+		}
+
+		if (y + surface->h > page_height[page]) {
+			page_height[page] = y + surface->h;
+		}
+
+		if (surface->h > shelf) {
+			shelf = surface->h;
+		}
+
+		used = SDL_TRUE;
+	}
+
+	return used ? page + 1 : first_page;
+}
+
+// Shrink the frame to its rectangle on the page for the step, smoothing it, so small steps still look clean.
+static int blit_scaled_entry(Game *game, AtlasEntry *entry, SDL_Surface *page, int step)
+{
+	SDL_Rect rect;
+	scale_rect(&entry->frame->rect, step, &rect);
+	SDL_Surface *scaled = zoomSurface(entry->surface, (double)rect.w / entry->surface->w, (double)rect.h / entry->surface->h, SMOOTHING_ON);
+
+	if (scaled == NULL) {
+		fprintf(stderr, "%s: Failed to scale a frame. %s\n", game->title, SDL_GetError());
+		return 1;
+	}
+
+	SDL_SetSurfaceBlendMode(scaled, SDL_BLENDMODE_NONE);
+	SDL_BlitSurface(scaled, NULL, page, &rect);
+	SDL_FreeSurface(scaled);
+	return 0;
+}
+
+static SDL_Texture *create_atlas_page(Game *game, int page, int width, int height, SDL_bool opaque, int step)
+{
+	SDL_Rect size = { 0, 0, width, height };
+	scale_rect(&size, step, &size);
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, size.w, size.h, 32, SDL_PIXELFORMAT_RGBA32);
+
+	if (surface == NULL) {
+		fprintf(stderr, "%s: %s\n", game->title, SDL_GetError());
+		return NULL;
+	}
+
+	SDL_FillRect(surface, NULL, 0);
+
+	for (int i = 0; i < game->atlas.entry_count; i++) {
+		if (game->atlas.entry[i].frame->page != page) {
+			continue;
+		}
+
+		// Copy pixels and alpha as they are rather than blending them onto the page.
+		SDL_SetSurfaceBlendMode(game->atlas.entry[i].surface, SDL_BLENDMODE_NONE);
+
+		if (step == 0) {
+			SDL_BlitSurface(game->atlas.entry[i].surface, NULL, surface, &game->atlas.entry[i].frame->rect);
+		} else if (blit_scaled_entry(game, &game->atlas.entry[i], surface, step) != 0) {
+			SDL_FreeSurface(surface);
+			return NULL;
+		}
+	}
+
+	SDL_Texture *texture = SDL_CreateTextureFromSurface(game->renderer, surface);
+	SDL_FreeSurface(surface);
+
+	if (texture == NULL) {
+		fprintf(stderr, "%s: %s\n", game->title, SDL_GetError());
+		return NULL;
+	}
+
+	// Opaque images (the background) are kept on their own pages so they can be drawn without blending.
+	SDL_SetTextureBlendMode(texture, opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+	return texture;
+}
+
+static void free_atlas_entries(Game *game)
+{
+	for (int i = 0; i < game->atlas.entry_count; i++) {
+		SDL_FreeSurface(game->atlas.entry[i].surface);
+	}
+
+	free(game->atlas.entry);
+	game->atlas.entry = NULL;
+	game->atlas.entry_count = 0;
+}
+
+static int atlas_size(Game *game)
+{
+	int size = ATLAS_SIZE;
+	SDL_RendererInfo info;
+
+	if (SDL_GetRendererInfo(game->renderer, &info) == 0) {
+		if (info.max_texture_width > 0 && info.max_texture_width < size) {
+			size = info.max_texture_width;
+		}
+
+		if (info.max_texture_height > 0 && info.max_texture_height < size) {
+			size = info.max_texture_height;
+		}
+	}
+
+	return size;
+}
+
+static void evict_group(Game *game, int group)
+{
+	AtlasGroup *atlas_group = &game->atlas.group[group];
+
+	for (int i = 0; i < MAX_ATLAS_PAGES; i++) {
+		for (int step = 0; step < RESOLUTION_STEPS && (atlas_group->pages & (1u << i)); step++) {
+			SDL_DestroyTexture(game->atlas.page[step][i]);
+			game->atlas.page[step][i] = NULL;
+		}
+	}
+
+	if (atlas_group->is_resident) {
+		game->atlas.resident_bytes -= atlas_group->bytes;
+	}
+
+	atlas_group->pages = 0;
+	atlas_group->is_resident = SDL_FALSE;
+}
+
+static int add_group_entries(Game *game, int group)
+{
+	for (int image = 0; image < IMAGES; image++) {
+		Sprite *sprite = game->atlas.sprite[image];
+		LoadJob *job = &game->loader.job[image];
+
+		if (image_group(image) != group || sprite == NULL) {
+			continue;
+		}
+
+		int status = job->pack_sprite != NULL ? add_pack_frames(game, sprite, job->pack_sprite) : add_decoded_frames(game, sprite, image);
+
+		if (status != 0) {
+			return status;
+		}
+	}
+
+	return 0;
+}
+
+// Pack the group's frames into pages of their own, in whichever page slots are free.
+static int build_group(Game *game, int group)
+{
+	AtlasGroup *atlas_group = &game->atlas.group[group];
+	int page_width[MAX_ATLAS_PAGES] = { 0 };
+	int page_height[MAX_ATLAS_PAGES] = { 0 };
+	int slot[MAX_ATLAS_PAGES];
+	int size = atlas_size(game);
+	int pages = -1;
+
+	if (add_group_entries(game, group) == 0) {
+		qsort(game->atlas.entry, game->atlas.entry_count, sizeof(AtlasEntry), compare_atlas_entries);
+		int opaque_pages = place_atlas_entries(game, SDL_TRUE, 0, size, page_width, page_height);
+		pages = opaque_pages < 0 ? -1 : place_atlas_entries(game, SDL_FALSE, opaque_pages, size, page_width, page_height);
+
+		for (int i = 0, s = 0; i < pages; i++, s++) {
+			while (s < MAX_ATLAS_PAGES && game->atlas.page[0][s] != NULL) {
+				s++;
+			}
+
+			if (s == MAX_ATLAS_PAGES) {
+				fprintf(stderr, "%s: Too many atlas pages.\n", game->title);
+				pages = -1;
+				break;
+			}
+
+			slot[i] = s;
+			atlas_group->pages |= 1u << s;
+
+			for (int step = 0; step < game->atlas.steps && pages >= 0; step++) {
+				game->atlas.page[step][s] = create_atlas_page(game, i, page_width[i], page_height[i], i < opaque_pages, step);
+
+				if (game->atlas.page[step][s] == NULL) {
+					pages = -1;
+				}
+			}
+
+			if (pages < 0) {
+				break;
+			}
+		}
+	}
+
+	if (pages < 0) {
+		free_atlas_entries(game);
+		evict_group(game, group);
+		return 1;
+	}
+
+	// The frames were placed by page within the group, so move them to the slots the pages went in.
+	for (int i = 0; i < game->atlas.entry_count; i++) {
+		game->atlas.entry[i].frame->page = slot[game->atlas.entry[i].frame->page];
+	}
+
+	free_atlas_entries(game);
+	atlas_group->bytes = 0;
+
+	for (int i = 0; i < pages; i++) {
+		for (int step = 0; step < game->atlas.steps; step++) {
+			SDL_Rect size = { 0, 0, page_width[i], page_height[i] };
+			scale_rect(&size, step, &size);
+			atlas_group->bytes += (size_t)size.w * size.h * 4;
+		}
+	}
+
+	atlas_group->is_resident = SDL_TRUE;
+	game->atlas.resident_bytes += atlas_group->bytes;
+	return 0;
+}
+
+// Texture memory the group needs, as last built, or at least the area of its frames at each step if it has never been built.
+static size_t group_bytes(Game *game, int group)
+{
+	size_t bytes = 0;
+	size_t area = 0;
+
+	if (game->atlas.group[group].bytes != 0) {
+		return game->atlas.group[group].bytes;
+	}
+
+	for (int image = 0; image < IMAGES; image++) {
+		if (image_group(image) == group && game->atlas.sprite[image] != NULL) {
+			Sprite *sprite = game->atlas.sprite[image];
+			bytes += (size_t)sprite->width * sprite->height * 4 * (sprite->frame_count + 1);
+		}
+	}
+
+	for (int step = 0; step < game->atlas.steps; step++) {
+		area += resolution_scales[step] * resolution_scales[step];
+	}
+
+	return bytes * area / 10000;
+}
+
+static SDL_bool fits_budget(Game *game, size_t bytes)
+{
+	return game->atlas.budget == 0 || game->atlas.resident_bytes + bytes <= (size_t)game->atlas.budget << 20;
+}
+
+// Decode the group in the background, and build it once it is decoded, if it fits the budget.
+static void prefetch_group(Game *game, int group)
+{
+	SDL_bool is_ready = SDL_TRUE;
+
+	for (int image = 0; image < IMAGES; image++) {
+		if (image_group(image) == group && !prefetch_job(game, image)) {
+			is_ready = SDL_FALSE;
+		}
+	}
+
+	// A failure is reported, and the group is tried again when it is needed.
+	if (is_ready && fits_budget(game, group_bytes(game, group))) {
+		build_group(game, group);
+	}
+}
+
+// Evict the groups needed longest ago until within the budget, keeping those needed now and the one prefetched.
+static void evict_groups(Game *game, int prefetched)
+{
+	Atlas *atlas = &game->atlas;
+
+	while (!fits_budget(game, 0)) {
+		int oldest = -1;
+
+		for (int group = 0; group < ATLAS_GROUPS; group++) {
+			if (!atlas->group[group].is_resident || atlas->group[group].last_needed == atlas->clock || group == prefetched) {
+				continue;
+			}
+
+			if (oldest < 0 || atlas->group[group].last_needed < atlas->group[oldest].last_needed) {
+				oldest = group;
+			}
+		}
+
+		if (oldest < 0) {
+			return;
+		}
+
+		evict_group(game, oldest);
+	}
+}
+
+/*
+	Called before drawing each frame. Builds any group the current level
+	needs and is missing, which stalls until its frames are decoded, and
+	gets the next level's aliens ready while this level is played. The
+	alien types are those of the scene being drawn, not of the simulation.
+*/
+int update_residency(Game *game, int alien_type)
+{
+	Atlas *atlas = &game->atlas;
+	int next = alien_type;
+	atlas->clock++;
+
+	for (int group = 0; group < alien_type; group++) {
+		atlas->group[group].last_needed = atlas->clock;
+
+		if (!atlas->group[group].is_resident && build_group(game, group) != 0) {
+			return 1;
+		}
+	}
+
+	if (next < ATLAS_GROUPS && !atlas->group[next].is_resident) {
+		prefetch_group(game, next);
+	}
+
+	evict_groups(game, next);
+	return 0;
+}
+
+static void set_sprite_defaults(Sprite *sprite)
+{
+	sprite->frame = NULL;
+	sprite->x = sprite->y = 0.0;
+	sprite->prev_x = sprite->prev_y = 0.0;
+	sprite->width = sprite->height = 0;
+	sprite->current_frame = sprite->frame_delay = sprite->next_frame_time = 0;
+	sprite->dx = sprite->dy = 0.0;
+	sprite->is_visible = SDL_FALSE;
+	sprite->is_animated = SDL_FALSE;
+}
+
+static int initialise_sprite(Game *game, Sprite *sprite, int image)
+{
+	set_sprite_defaults(sprite);
+	return load_sprite(game, sprite, image);
+}
+
+static int init_bigblue(Game *game)
+{
+	int status = initialise_sprite(game, &game->bigblue.sprite, IMAGE_BIGBLUE);
+
+	if (status != 0) {
+		return status;
+	}
+
+	reset_bigblue(game);
+	return 0;
+}
+
+// The starfield leaves the background sprite without frames, only scrolling the size of the window.
+static int init_background(Game *game)
+{
+	if (!game->starfield.is_enabled) {
+		return initialise_sprite(game, &game->background, IMAGE_BACKGROUND);
+	}
+
+	set_sprite_defaults(&game->background);
+	game->background.width = game->width;
+	game->background.height = game->height;
+	return 0;
+}
+
+static int init_player(Game *game)
+{
+	Sprite *sprite = &game->player[0].craft.sprite;
+	init_craft(&game->player[0].craft);
+	int status = initialise_sprite(game, sprite, IMAGE_PLAYER);
+	sprite->x = game->width / 2 - sprite->width / 2;
+	sprite->y = game->height - sprite->height - 20;
+	sprite->is_animated = SDL_TRUE;
+	sprite->frame_delay = 1;
+	sprite->is_visible = SDL_TRUE;
+	return status;
+}
+
+static int init_alien_type(Game *game, int indx)
+{
+	EntityStore *aliens = &game->aliens;
+	int status = initialise_sprite(game, &game->alien_sprite[indx], IMAGE_PURPLE + indx);
+
+	if (status != 0) {
+		return status;
+	}
+
+	for (int k = indx * game->alien_count; k < (indx + 1) * game->alien_count; k++) {
+		aliens->width[k] = game->alien_sprite[indx].width;
+		aliens->height[k] = game->alien_sprite[indx].height;
+		aliens->animation[k].type = indx;
+	}
+
+	return 0;
+}
+
+static int init_aliens(Game *game)
+{
+	init_entity_store(game, &game->aliens, ALIEN_TYPE * game->alien_count);
+	init_grid(game, &game->alien_grid, game->aliens.capacity);
+	init_projectile_pool(game, &game->projectiles, PROJECTILE_POOL_SIZE + game->aliens.capacity);
+	int status = 0;
+
+	for (int i = 0; i < ALIEN_TYPE && status == 0; i++) {
+		status = init_alien_type(game, i);
+	}
+
+	reset_aliens(game);
+	return status;
+}
+
+static int init_explosion(Game *game)
+{
+	int status = initialise_sprite(game, &game->explosion, IMAGE_EXPLOSION);
+	game->explosion.is_animated = SDL_TRUE;
+	return status;
+}
+
+static int init_missile(Game *game)
+{
+	int status = initialise_sprite(game, &game->missile, IMAGE_MISSILE);
+	game->missile.x = game->missile.y = 0;
+	game->missile.frame_delay = 3;
+	game->missile.is_animated = SDL_TRUE;
+	game->missile.is_visible = SDL_TRUE;
+	return status;
+}
+
+static int init_playmis(Game *game)
+{
+	int status = initialise_sprite(game, &game->playmis, IMAGE_PLAYMIS);
+	game->playmis.x = game->playmis.y = 0;
+	game->playmis.is_visible = SDL_TRUE;
+	game->playmis.frame_delay = 3;
+	game->playmis.is_animated = SDL_TRUE;
+	return status;
+}
+
+static int init_line(Game *game)
+{
+	int status = initialise_sprite(game, &game->line, IMAGE_LINE);
+	game->line.x = 50;
+	game->line.y = LINE_Y;
+	game->line.is_visible = SDL_TRUE;
+	return status;
+}
+
+static int init_asteroid_quarters(Game *game)
+{
+	int status = 0;
+
+	for (int i = 0; i < QUARTERS && status == 0; i++) {
+		status = initialise_sprite(game, &game->quarter[i].sprite, IMAGE_UL + i);
+		game->quarter[i].sprite.is_animated = SDL_TRUE;
+	}
+
+	return status;
+}
+
+static void init_atlas(Atlas *atlas)
+{
+	atlas->entry = NULL;
+	atlas->entry_count = 0;
+	atlas->resident_bytes = 0;
+	atlas->clock = 0;
+
+	for (int i = 0; i < IMAGES; i++) {
+		atlas->sprite[i] = NULL;
+	}
+
+	for (int i = 0; i < ATLAS_GROUPS; i++) {
+		atlas->group[i].is_resident = SDL_FALSE;
+		atlas->group[i].pages = 0;
+		atlas->group[i].bytes = 0;
+		atlas->group[i].last_needed = 0;
+	}
+
+	for (int step = 0; step < RESOLUTION_STEPS; step++) {
+		for (int i = 0; i < MAX_ATLAS_PAGES; i++) {
+			atlas->page[step][i] = NULL;
+		}
+	}
+}
+
+// Takes the images from the loader, which must have been started by start_loading().
+int init_sprites(Game *game)
+{
+	init_atlas(&game->atlas);
+	int status = init_bigblue(game);
+
+	if (status == 0) {
+		status = init_player(game);
+	}
+
+	if (status == 0) {
+		status = init_aliens(game);
+	}
+
+	if (status == 0) {
+		status = init_background(game);
+	}
+
+	if (status == 0) {
+		status = init_explosion(game);
+	}
+
+	if (status == 0) {
+		status = init_missile(game);
+	}
+
+	if (status == 0) {
+		status = init_playmis(game);
+	}
+
+	if (status == 0)
+		status = init_line(game);
+
+	if (status == 0) {
+		status = initialise_sprite(game, &game->asteroid.sprite, IMAGE_ASTEROID);
+	}
+
+	if (status == 0) {
+		status = init_asteroid_quarters(game);
+	}
+
+	// Without a renderer (the headless simulator) only the sprite dimensions are needed.
+	if (status == 0 && game->renderer != NULL) {
+		status = update_residency(game, game->alien_type);
+	}
+
+	return status;
+}
+
+static void free_sprite(Sprite *sprite)
+{
+	free(sprite->frame);
+}
+
+void free_sprites(Game *game)
+{
+	free_sprite(&game->background);
+	free_sprite(&game->explosion);
+	free_sprite(&game->line);
+	free_sprite(&game->missile);
+	free_sprite(&game->playmis);
+	free_sprite(&game->asteroid.sprite);
+	free_sprite(&game->bigblue.sprite);
+	free_sprite(&game->player[0].craft.sprite);
+
+	for (int i = 0; i < QUARTERS; i++) {
+		free_sprite(&game->quarter[i].sprite);
+	}
+
+	for (int i = 0; i < ALIEN_TYPE; i++) {
+		free_sprite(&game->alien_sprite[i]);
+	}
+
+	free_entity_store(&game->aliens);
+	free_grid(&game->alien_grid);
+	free_projectile_pool(&game->projectiles);
+
+	for (int group = 0; group < ATLAS_GROUPS; group++) {
+		evict_group(game, group);
+	}
+}
@@ -0,0 +1,124 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	With -S the background image is replaced by layers of stars, placed from
+	a fixed seed so the sky is the same every game. Nearer layers are
+	brighter and scroll faster. Each layer is one batch of points or small
+	rectangles over a black fill, which fills far fewer pixels than
+	copying the image, and there is no image to decode or keep as a texture.
+	The layers follow the simulation's background scroll, at whole multiples
+	of it, so they wrap with it seamlessly.
+*/
+
+#include <stdlib.h>
+#include "shipxb11.h"
+
+// Far to near. Counts are for the default 600 by 800 window, and scale with its area.
+static const StarLayer layer_defaults[STAR_LAYERS] = {
+	{ 180, 1, 1, 90, NULL },
+	{ 70, 2, 1, 170, NULL },
+	{ 24, 3, 2, 255, NULL }
+};
+
+// Call once the window's size is known. Does nothing without -S.
+void init_starfield(Game *game)
+{
+	Starfield *starfield = &game->starfield;
+	Uint32 state = STARFIELD_SEED;
+	int most = 0;
+	starfield->scroll = 0.0;
+
+	if (!starfield->is_enabled) {
+		return;
+	}
+
+	for (int i = 0; i < STAR_LAYERS; i++) {
+		StarLayer *layer = &starfield->layer[i];
+		*layer = layer_defaults[i];
+		layer->count = SDL_max(1, (int)((long)layer->count * game->width * game->height / (WIDTH * HEIGHT)));
+		layer->star = allocate(game, sizeof(SDL_Point) * layer->count, __func__);
+
+		for (int k = 0; k < layer->count; k++) {
+			layer->star[k].x = xorshift32(&state) % game->width;
+			layer->star[k].y = xorshift32(&state) % game->height;
+		}
+
+		most = SDL_max(most, layer->count);
+	}
+
+	starfield->point = allocate(game, sizeof(SDL_Point) * most, __func__);
+	starfield->rect = allocate(game, sizeof(SDL_Rect) * most, __func__);
+}
+
+static void draw_layer(Game *game, StarLayer *layer, int offset)
+{
+	Starfield *starfield = &game->starfield;
+
+	for (int k = 0; k < layer->count; k++) {
+		int y = (layer->star[k].y + offset) % game->height;
+
+		if (layer->size == 1) {
+			starfield->point[k].x = layer->star[k].x;
+			starfield->point[k].y = y;
+		} else {
+			set_rect(starfield->rect[k], layer->star[k].x, y, layer->size, layer->size);
+		}
+	}
+
+	SDL_SetRenderDrawColor(game->renderer, layer->brightness, layer->brightness, SDL_min(255, layer->brightness + 40), SDL_ALPHA_OPAQUE);
+
+	if (layer->size == 1) {
+		SDL_RenderDrawPoints(game->renderer, starfield->point, layer->count);
+	} else {
+		SDL_RenderFillRects(game->renderer, starfield->rect, layer->count);
+	}
+}
+
+// Fill the screen, or as much as is clipped to, with black and draw the stars over it, before the queued quads go over them.
+void draw_starfield(Game *game)
+{
+	Uint8 r, g, b, a;
+
+	SDL_GetRenderDrawColor(game->renderer, &r, &g, &b, &a);
+	SDL_SetRenderDrawColor(game->renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+	SDL_RenderFillRect(game->renderer, NULL);
+
+	for (int i = 0; i < STAR_LAYERS; i++) {
+		StarLayer *layer = &game->starfield.layer[i];
+		draw_layer(game, layer, (int)(game->starfield.scroll * layer->speed) % game->height);
+	}
+
+	SDL_SetRenderDrawColor(game->renderer, r, g, b, a);
+}
+
+void free_starfield(Game *game)
+{
+	Starfield *starfield = &game->starfield;
+
+	if (!starfield->is_enabled) {
+		return;
+	}
+
+	for (int i = 0; i < STAR_LAYERS; i++) {
+		free(starfield->layer[i].star);
+	}
+
+	free(starfield->point);
+	free(starfield->rect);
+}
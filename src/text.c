@@ -0,0 +1,172 @@
+/*
+	shipxb11
+	Copyright (C) 2022 Craig McPartland
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Renders the printable ASCII glyphs of the game font once, in rows across
+	one texture, and keeps their metrics and kerning. A string is then drawn
+	as one quad per glyph from that texture, so text that changes every frame
+	costs no surfaces, textures or allocations.
+*/
+
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include "shipxb11.h"
+
+static void free_glyph_surfaces(SDL_Surface **surface, int count)
+{
+	for (int i = 0; i < count; i++) {
+		SDL_FreeSurface(surface[i]);
+	}
+}
+
+// Render each glyph as a string of one character, so it sits in its rectangle as TTF_RenderText would place it.
+static int render_glyphs(Game *game, SDL_Surface **surface)
+{
+	SDL_Color colour = { 255, 255, 0, 128 };
+	GlyphAtlas *text = &game->text;
+	int minx, maxx, miny, maxy;
+
+	for (int i = 0; i < GLYPHS; i++) {
+		char string[] = { FIRST_GLYPH + i, '\0' };
+		surface[i] = TTF_RenderText_Solid(game->font, string, colour);
+
+		if (surface[i] == NULL || TTF_GlyphMetrics(game->font, FIRST_GLYPH + i, &minx, &maxx, &miny, &maxy, &text->glyph[i].advance) != 0) {
+			fprintf(stderr, "%s: Failed to render glyph '%c'. %s\n", game->title, FIRST_GLYPH + i, TTF_GetError());
+			free_glyph_surfaces(surface, i + (surface[i] != NULL));
+			return 1;
+		}
+
+		text->glyph[i].offset = SDL_min(0, minx);
+		text->height = SDL_max(text->height, surface[i]->h);
+	}
+
+	return 0;
+}
+
+static SDL_Surface *create_glyph_page(Game *game, SDL_Surface **surface)
+{
+	GlyphAtlas *text = &game->text;
+	int x = 0;
+	int y = 0;
+
+	for (int i = 0; i < GLYPHS; i++) {
+		if (x + surface[i]->w > GLYPH_ATLAS_WIDTH) {
+			x = 0;
+			y += text->height + ATLAS_PADDING;
+		}
+
+		set_rect(text->glyph[i].rect, x, y, surface[i]->w, surface[i]->h);
+		x += surface[i]->w + ATLAS_PADDING;
+	}
+
+	SDL_Surface *page = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + text->height, 32, SDL_PIXELFORMAT_RGBA32);
+
+	if (page == NULL) {
+		return NULL;
+	}
+
+	for (int i = 0; i < GLYPHS; i++) {
+		SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface[i], SDL_PIXELFORMAT_RGBA32, 0);
+
+		if (converted == NULL) {
+			SDL_FreeSurface(page);
+			return NULL;
+		}
+
+		// Copy the transparent pixels too, rather than blend them into the page.
+		SDL_SetSurfaceBlendMode(converted, SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(converted, NULL, page, &text->glyph[i].rect);
+		SDL_FreeSurface(converted);
+	}
+
+	return page;
+}
+
+int init_text(Game *game)
+{
+	GlyphAtlas *text = &game->text;
+	SDL_Surface *surface[GLYPHS];
+
+	text->texture = NULL;
+	text->height = 0;
+
+	if (render_glyphs(game, surface) != 0) {
+		return 1;
+	}
+
+	SDL_Surface *page = create_glyph_page(game, surface);
+	free_glyph_surfaces(surface, GLYPHS);
+
+	if (page != NULL) {
+		text->texture = SDL_CreateTextureFromSurface(game->renderer, page);
+		SDL_FreeSurface(page);
+	}
+
+	if (text->texture == NULL) {
+		fprintf(stderr, "%s: Failed to create the glyph atlas. %s\n", game->title, SDL_GetError());
+		return 1;
+	}
+
+	SDL_SetTextureBlendMode(text->texture, SDL_BLENDMODE_BLEND);
+
+	for (int i = 0; i < GLYPHS; i++) {
+		for (int j = 0; j < GLYPHS; j++) {
+			int kerning = TTF_GetFontKerningSizeGlyphs(game->font, FIRST_GLYPH + i, FIRST_GLYPH + j);
+			text->kerning[i][j] = SDL_clamp(kerning, -128, 127);
+		}
+	}
+
+	return 0;
+}
+
+// Characters the atlas does not hold are drawn as '?'.
+Glyph *find_glyph(GlyphAtlas *text, char c)
+{
+	int i = (unsigned char)c - FIRST_GLYPH;
+	return &text->glyph[i >= 0 && i < GLYPHS ? i : '?' - FIRST_GLYPH];
+}
+
+int glyph_kerning(GlyphAtlas *text, char previous, char c)
+{
+	int i = (unsigned char)previous - FIRST_GLYPH;
+	int j = (unsigned char)c - FIRST_GLYPH;
+
+	if (i < 0 || i >= GLYPHS || j < 0 || j >= GLYPHS) {
+		return 0;
+	}
+
+	return text->kerning[i][j];
+}
+
+// Distance from the first pen position to the last, which is how far the string's glyphs are spread.
+int text_width(GlyphAtlas *text, const char *string)
+{
+	int width = 0;
+
+	for (int i = 0; string[i] != '\0'; i++) {
+		width += (i > 0 ? glyph_kerning(text, string[i - 1], string[i]) : 0) + find_glyph(text, string[i])->advance;
+	}
+
+	return width;
+}
+
+void free_text(Game *game)
+{
+	SDL_DestroyTexture(game->text.texture);
+	game->text.texture = NULL;
+}